@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+
+using namespace std::chrono_literals;
+
+// Размер элемента по умолчанию - sizeof(T), тогда бюджет в байтах эквивалентен лимиту по количеству
+template <typename T>
+struct SizeOf {
+    size_t operator()(const T&) const { return sizeof(T); }
+};
+
+// ConcurrentFIFOQueue из task-5, но лимит задаётся не количеством элементов, а бюджетом в байтах.
+// Размер элемента считает пользовательская функция size_of.
+//
+// - push ждёт, пока элемент не поместится в бюджет;
+// - элемент больше всего бюджета пропускается, когда очередь пуста, иначе он ждал бы вечно;
+// - ожидающие producer'ы допускаются строго по очереди: маленькие элементы не обгоняют большой,
+//   иначе он мог бы голодать под потоком мелких сообщений;
+// - pop будит только голову очереди producer'ов и только когда для неё освободилось достаточно байт.
+//   Допуская producer'а, pop сам перекладывает его элемент в очередь, поэтому порядок сохраняется,
+//   а несколько допущенных подряд не превысят бюджет.
+template <typename T, typename SizeFunc = SizeOf<T>>
+class ConcurrentFIFOQueue {
+public:
+    explicit ConcurrentFIFOQueue(size_t byte_budget, SizeFunc size_of = SizeFunc{})
+        : _budget(byte_budget), _size_of(std::move(size_of)) {}
+
+    void push(const T& val) { push_sized(T{val}); }
+
+    void push(T&& val) { push_sized(std::move(val)); }
+
+    T pop() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (_queue.empty()) {
+            TRACE_WAIT_BEGIN(&_not_empty_cv);
+            _not_empty_cv.wait(l, [this]() { return !_queue.empty(); });
+            TRACE_WAIT_END(&_not_empty_cv);
+        }
+
+        auto [val, bytes] = std::move(_queue.front());
+        _queue.pop();
+        _used -= bytes;
+        admit_waiters();
+        return std::move(val);
+    }
+
+    // Байты, занятые элементами в очереди
+    size_t bytes_used() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        return _used;
+    }
+
+private:
+    struct Waiter {
+        Waiter(T* val, size_t bytes) : val(val), bytes(bytes) {}
+
+        T* val;
+        size_t bytes;
+        std::condition_variable cv;
+        bool admitted{};
+    };
+
+    void push_sized(T&& val) {
+        size_t bytes = _size_of(val);
+
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (_waiters.empty() && fits(bytes)) {
+            enqueue(std::move(val), bytes);
+            return;
+        }
+
+        Waiter w{&val, bytes};
+        _waiters.push_back(&w);
+        TRACE_WAIT_BEGIN(&w);
+        w.cv.wait(l, [&w]() { return w.admitted; });
+        TRACE_WAIT_END(&w);
+    }
+
+    bool fits(size_t bytes) const { return _used + bytes <= _budget || _used == 0; }
+
+    void enqueue(T&& val, size_t bytes) {
+        _queue.emplace(std::move(val), bytes);
+        _used += bytes;
+        TRACE_NOTIFY(&_not_empty_cv);
+        _not_empty_cv.notify_one();
+    }
+
+    void admit_waiters() {
+        while (!_waiters.empty() && fits(_waiters.front()->bytes)) {
+            Waiter* w = _waiters.front();
+            _waiters.pop_front();
+            enqueue(std::move(*w->val), w->bytes);
+            w->admitted = true;
+            TRACE_NOTIFY(w);
+            w->cv.notify_one();
+        }
+    }
+
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::queue<std::pair<T, size_t>> _queue;
+    std::deque<Waiter*> _waiters;
+
+    size_t _budget;
+    size_t _used{};
+    SizeFunc _size_of;
+};
+
+struct StringSize {
+    size_t operator()(const std::string& s) const { return s.size(); }
+};
+
+using StringQueue = ConcurrentFIFOQueue<std::string, StringSize>;
+
+/*
+ * Тесты
+ */
+TEST(test_multiple_push_pop) {
+    ConcurrentFIFOQueue<int> queue{3 * sizeof(int)};
+
+    queue.push(1);
+    queue.push(2);
+    queue.push(3);
+    EXPECT_EQ(queue.bytes_used(), 3 * sizeof(int));
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_EQ(queue.pop(), 3);
+    EXPECT_EQ(queue.bytes_used(), 0u);
+}
+
+TEST(test_push_waits_for_bytes) {
+    StringQueue queue{100};
+    queue.push(std::string(30, 'a'));
+    queue.push(std::string(60, 'b'));
+
+    std::atomic_bool pushed{false};
+    std::thread producer{[&]() {
+        queue.push(std::string(50, 'c'));
+        pushed = true;
+    }};
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(pushed.load());
+
+    // Освободилось 30 байт: 60 + 50 всё ещё не помещается, producer не должен проснуться
+    EXPECT(queue.pop() == std::string(30, 'a'));
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(pushed.load());
+
+    // Ушёл большой элемент - места достаточно
+    EXPECT(queue.pop() == std::string(60, 'b'));
+    producer.join();
+    EXPECT_TRUE(pushed.load());
+    EXPECT_EQ(queue.bytes_used(), 50u);
+}
+
+TEST(test_oversize_element) {
+    StringQueue queue{10};
+
+    // Пустая очередь принимает элемент больше бюджета
+    queue.push(std::string(100, 'x'));
+    EXPECT_EQ(queue.bytes_used(), 100u);
+
+    std::atomic_bool pushed{false};
+    std::thread producer{[&]() {
+        queue.push(std::string(1, 'y'));
+        pushed = true;
+    }};
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(pushed.load());  // Бюджет превышен - ждём
+
+    EXPECT_EQ(queue.pop().size(), 100u);
+    producer.join();
+    EXPECT(queue.pop() == "y");
+}
+
+TEST(test_waiters_admitted_in_order) {
+    StringQueue queue{10};
+    queue.push(std::string(10, 'a'));
+
+    // Большой элемент ждёт первым, маленький не должен его обогнать, хотя для него место появится раньше
+    std::thread big{[&]() { queue.push(std::string(8, 'b')); }};
+    std::this_thread::sleep_for(10ms);
+
+    std::thread small{[&]() { queue.push(std::string(1, 'c')); }};
+    std::this_thread::sleep_for(10ms);
+
+    queue.pop();
+    big.join();
+    small.join();
+
+    EXPECT_EQ(queue.pop().size(), 8u);
+    EXPECT_EQ(queue.pop().size(), 1u);
+}
+
+TEST(test_multiple_threads) {
+    constexpr auto NumThreads = 4;
+    constexpr auto N = 200;
+    constexpr size_t Budget = 4096;
+
+    StringQueue queue{Budget};
+    std::atomic<size_t> max_used{0};
+
+    std::vector<size_t> consumed;
+    std::mutex consumed_mutex;
+
+    auto producer_func = [&](int thread_num) {
+        for (int i = 0; i < N; ++i) {
+            size_t id = thread_num * N + i;
+            // Размеры от 1 до 2048 байт, id кодируется в длине префикса
+            std::string msg = std::to_string(id) + ":" + std::string(id * 37 % 2048, 'x');
+            queue.push(std::move(msg));
+        }
+    };
+
+    auto consumer_func = [&]() {
+        for (int i = 0; i < N; ++i) {
+            size_t used = queue.bytes_used();
+            size_t prev = max_used.load();
+            while (used > prev && !max_used.compare_exchange_weak(prev, used)) {
+            }
+
+            std::string msg = queue.pop();
+            std::lock_guard<std::mutex> lock(consumed_mutex);
+            consumed.push_back(std::stoul(msg));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NumThreads; ++i) {
+        threads.emplace_back(producer_func, i);
+        threads.emplace_back(consumer_func);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_LE(max_used.load(), Budget);
+    EXPECT_EQ(consumed.size(), size_t{N * NumThreads});
+    std::sort(consumed.begin(), consumed.end());
+    for (size_t i = 0; i < consumed.size(); ++i) {
+        EXPECT_EQ(consumed[i], i);
+    }
+}
+
+int main() {
+    RUN_TESTS();
+    return 0;
+}
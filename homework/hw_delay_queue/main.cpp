@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+
+using namespace std::chrono_literals;
+
+// DelayQueue - очередь отложенных задач: элемент, добавленный через push(item, due_time), можно извлечь
+// только после наступления due_time. Элементы выдаются в порядке сроков.
+//
+// - pop блокируется через wait_until на ближайший срок, а не опрашивает очередь;
+// - push будит потребителя, только если новый элемент стал самым ранним;
+// - cancel(handle) за O(1): элемент уничтожается сразу, а его запись в куче удаляется лениво,
+//   когда всплывёт наверх (или при перестроении кучи, если отменённых стало больше, чем живых).
+template <typename T>
+class DelayQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Handle для отмены. Поколение защищает от отмены чужого элемента, занявшего тот же слот.
+    struct Handle {
+        uint32_t slot{};
+        uint32_t generation{};
+    };
+
+    Handle push(const T& val, Clock::time_point due) { return emplace(T{val}, due); }
+
+    Handle push(T&& val, Clock::time_point due) { return emplace(std::move(val), due); }
+
+    // Возвращает true, если элемент был отменён до того, как его извлекли
+    bool cancel(Handle h) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (h.slot >= _slots.size()) {
+            return false;
+        }
+        Slot& slot = _slots[h.slot];
+        if (slot.generation != h.generation || !slot.item) {
+            return false;
+        }
+        slot.item.reset();
+        _live--;
+        if (_heap.size() > 2 * _live + 64) {
+            compact();
+        }
+        return true;
+    }
+
+    T pop() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        for (;;) {
+            drop_cancelled();
+            if (_heap.empty()) {
+                TRACE_WAIT_BEGIN(&_cv);
+                _cv.wait(l);
+                TRACE_WAIT_END(&_cv);
+                continue;
+            }
+
+            Clock::time_point due = _heap.front().due;
+            if (Clock::now() >= due) {
+                T val = take_top();
+                if (!_heap.empty()) {
+                    // Следующий элемент может быть тоже уже готов - пусть его заберёт другой потребитель
+                    TRACE_NOTIFY(&_cv);
+                    _cv.notify_one();
+                }
+                return val;
+            }
+            TRACE_WAIT_BEGIN(&_cv);
+            _cv.wait_until(l, due);
+            TRACE_WAIT_END(&_cv);
+        }
+    }
+
+    // Не блокируется, возвращает false, если готовых элементов нет
+    bool try_pop(T& out) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        drop_cancelled();
+        if (_heap.empty() || Clock::now() < _heap.front().due) {
+            return false;
+        }
+        out = take_top();
+        return true;
+    }
+
+    // Количество не отменённых и ещё не извлечённых элементов
+    size_t size() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        return _live;
+    }
+
+private:
+    struct Slot {
+        std::optional<T> item;
+        uint32_t generation{};
+    };
+
+    struct Entry {
+        Clock::time_point due;
+        uint64_t seq;  // при равных сроках сохраняет порядок добавления
+        uint32_t slot;
+    };
+
+    static bool later(const Entry& a, const Entry& b) {
+        return a.due != b.due ? a.due > b.due : a.seq > b.seq;
+    }
+
+    Handle emplace(T&& val, Clock::time_point due) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+
+        uint32_t index;
+        if (!_free_slots.empty()) {
+            index = _free_slots.back();
+            _free_slots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(_slots.size());
+            _slots.emplace_back();
+        }
+        Slot& slot = _slots[index];
+        slot.item.emplace(std::move(val));
+        _live++;
+
+        bool earliest = _heap.empty() || later(_heap.front(), Entry{due, _seq, index});
+        _heap.push_back(Entry{due, _seq++, index});
+        std::push_heap(_heap.begin(), _heap.end(), later);
+
+        if (earliest) {
+            // Потребители спят до прежнего ближайшего срока, новый наступит раньше
+            TRACE_NOTIFY(&_cv);
+            _cv.notify_one();
+        }
+        return Handle{index, slot.generation};
+    }
+
+    void release_slot(uint32_t index) {
+        _slots[index].generation++;
+        _free_slots.push_back(index);
+    }
+
+    void drop_cancelled() {
+        while (!_heap.empty() && !_slots[_heap.front().slot].item) {
+            std::pop_heap(_heap.begin(), _heap.end(), later);
+            release_slot(_heap.back().slot);
+            _heap.pop_back();
+        }
+    }
+
+    T take_top() {
+        std::pop_heap(_heap.begin(), _heap.end(), later);
+        uint32_t index = _heap.back().slot;
+        _heap.pop_back();
+
+        T val = std::move(*_slots[index].item);
+        _slots[index].item.reset();
+        release_slot(index);
+        _live--;
+        return val;
+    }
+
+    // Убирает из кучи все отменённые записи разом, чтобы массовые cancel не раздували её
+    void compact() {
+        auto cancelled = [this](const Entry& e) {
+            if (_slots[e.slot].item) {
+                return false;
+            }
+            release_slot(e.slot);
+            return true;
+        };
+        _heap.erase(std::remove_if(_heap.begin(), _heap.end(), cancelled), _heap.end());
+        std::make_heap(_heap.begin(), _heap.end(), later);
+    }
+
+    std::mutex _m;
+    std::condition_variable _cv;
+    std::vector<Entry> _heap;
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _free_slots;
+    size_t _live{};
+    uint64_t _seq{};
+};
+
+/*
+ * Тесты
+ */
+TEST(test_items_ordered_by_due_time) {
+    DelayQueue<int> queue;
+    auto now = std::chrono::steady_clock::now();
+
+    queue.push(3, now - 1ms);
+    queue.push(1, now - 3ms);
+    queue.push(2, now - 2ms);
+    queue.push(4, now - 1ms);  // тот же срок, что и у 3 - выдаётся после него
+
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_EQ(queue.pop(), 3);
+    EXPECT_EQ(queue.pop(), 4);
+}
+
+TEST(test_pop_waits_for_due_time) {
+    DelayQueue<int> queue;
+
+    auto start = std::chrono::steady_clock::now();
+    queue.push(1, start + 20ms);
+
+    int out = 0;
+    EXPECT_FALSE(queue.try_pop(out));
+
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 20ms);
+}
+
+TEST(test_sooner_item_wakes_consumer) {
+    DelayQueue<int> queue;
+    auto start = std::chrono::steady_clock::now();
+    queue.push(2, start + 10s);
+
+    std::atomic_int popped{0};
+    std::thread consumer{[&]() { popped = queue.pop(); }};
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(popped.load(), 0);  // Потребитель спит до срока далёкого элемента
+
+    queue.push(1, std::chrono::steady_clock::now() + 10ms);
+    consumer.join();
+
+    EXPECT_EQ(popped.load(), 1);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+}
+
+TEST(test_cancel) {
+    DelayQueue<int> queue;
+    auto now = std::chrono::steady_clock::now();
+
+    auto h1 = queue.push(1, now);
+    queue.push(2, now + 1ms);
+
+    EXPECT_TRUE(queue.cancel(h1));
+    EXPECT_FALSE(queue.cancel(h1));  // Повторная отмена ничего не делает
+    EXPECT_EQ(queue.size(), 1u);
+    EXPECT_EQ(queue.pop(), 2);
+
+    // Слот h1 переиспользован, но старый handle не должен отменить новый элемент
+    queue.push(3, now);
+    EXPECT_FALSE(queue.cancel(h1));
+    EXPECT_EQ(queue.pop(), 3);
+}
+
+REPEATED_TEST(test_many_timers, 2) {
+    constexpr int N = 100000;
+
+    DelayQueue<int> queue;
+    std::mt19937 rng{42};
+    auto base = std::chrono::steady_clock::now() - 1s;
+
+    std::vector<DelayQueue<int>::Handle> handles;
+    for (int i = 0; i < N; ++i) {
+        handles.push_back(queue.push(i, base + std::chrono::microseconds(rng() % 1000000)));
+    }
+    // Отменяем каждый второй - это так же запускает перестроение кучи
+    for (int i = 0; i < N; i += 2) {
+        EXPECT_TRUE(queue.cancel(handles[i]));
+    }
+    EXPECT_EQ(queue.size(), size_t{N / 2});
+
+    std::vector<bool> seen(N);
+    int out = 0;
+    int count = 0;
+    while (queue.try_pop(out)) {
+        EXPECT_EQ(out % 2, 1);
+        EXPECT_FALSE(seen[out]);
+        seen[out] = true;
+        ++count;
+    }
+    EXPECT_EQ(count, N / 2);
+}
+
+TEST(test_multiple_consumers) {
+    constexpr auto NumThreads = 4;
+    constexpr auto N = 100;
+
+    DelayQueue<int> queue;
+    std::atomic_int sum{0};
+
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < NumThreads; ++t) {
+        consumers.emplace_back([&]() {
+            for (int i = 0; i < N; ++i) {
+                sum += queue.pop();
+            }
+        });
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (int i = 0; i < NumThreads * N; ++i) {
+        queue.push(1, now + std::chrono::microseconds(i * 10));
+    }
+
+    for (auto& t : consumers) {
+        t.join();
+    }
+    EXPECT_EQ(sum.load(), NumThreads * N);
+}
+
+int main() {
+    RUN_TESTS();
+    return 0;
+}
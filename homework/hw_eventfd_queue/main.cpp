@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "tests.h"
+#include "trace.h"
+
+using namespace std::chrono_literals;
+
+// EventFd - обёртка над Linux eventfd, позволяющая регистрировать примитив в epoll наравне с сокетами.
+// Дескриптор неблокирующий: signal() увеличивает счётчик (fd становится читаемым), reset() обнуляет его.
+class EventFd {
+public:
+    EventFd() : _fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "eventfd");
+        }
+    }
+
+    EventFd(const EventFd&) = delete;
+    EventFd& operator=(const EventFd&) = delete;
+
+    ~EventFd() { ::close(_fd); }
+
+    void signal() {
+        uint64_t one = 1;
+        while (::write(_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+    }
+
+    void reset() {
+        uint64_t value;
+        while (::read(_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+        }
+    }
+
+    int fd() const { return _fd; }
+
+private:
+    int _fd;
+};
+
+// ConcurrentFIFOQueue с опциональным eventfd-уведомлением.
+// Помимо блокирующего pop, очередь можно обслуживать из epoll-цикла:
+// - native_handle() возвращает fd, который становится читаемым при переходе очереди из пустой в непустую;
+// - try_pop_all() без блокировки забирает все элементы и снимает готовность fd.
+// Запись в eventfd делается один раз на пачку: пока потребитель не вызвал try_pop_all, повторные push'и fd не трогают.
+template <typename T>
+class ConcurrentFIFOQueue {
+public:
+    explicit ConcurrentFIFOQueue(bool use_eventfd = false) {
+        if (use_eventfd) {
+            _event.emplace();
+        }
+    }
+
+    void push(const T& val) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        _queue.push(val);
+        notify_locked();
+    }
+
+    void push(T&& val) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        _queue.push(std::move(val));
+        notify_locked();
+    }
+
+    T pop() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (_queue.empty()) {
+            TRACE_WAIT_BEGIN(&_not_empty_cv);
+            _not_empty_cv.wait(l, [this]() { return !_queue.empty(); });
+            TRACE_WAIT_END(&_not_empty_cv);
+        }
+        T val = std::move(_queue.front());
+        _queue.pop();
+        // Очередь опустела - снимаем готовность fd, иначе epoll-цикл будет просыпаться впустую
+        if (_queue.empty() && _signaled) {
+            _event->reset();
+            _signaled = false;
+        }
+        return val;
+    }
+
+    // Забирает все элементы, не блокируясь. Возвращает количество извлечённых элементов.
+    // Сброс eventfd происходит под тем же lock'ом, что и извлечение, поэтому push, пришедший после,
+    // гарантированно снова взведёт fd.
+    template <typename OutputIt>
+    size_t try_pop_all(OutputIt out) {
+        std::queue<T> batch;
+        {
+            std::unique_lock l{_m};
+            TRACE_LOCK_ACQUIRED(&_m);
+            if (_signaled) {
+                _event->reset();
+                _signaled = false;
+            }
+            std::swap(batch, _queue);
+        }
+
+        size_t count = batch.size();
+        for (; !batch.empty(); batch.pop()) {
+            *out++ = std::move(batch.front());
+        }
+        return count;
+    }
+
+    // Дескриптор для epoll (EPOLLIN), либо -1, если очередь создана без eventfd.
+    int native_handle() const { return _event ? _event->fd() : -1; }
+
+private:
+    void notify_locked() {
+        TRACE_NOTIFY(&_not_empty_cv);
+        _not_empty_cv.notify_one();
+        if (_event && !_signaled) {
+            _event->signal();
+            _signaled = true;
+        }
+    }
+
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::queue<T> _queue;
+    std::optional<EventFd> _event;
+    bool _signaled{};
+};
+
+// ThreadFlag с опциональным eventfd: после set_flag() fd остаётся читаемым навсегда,
+// как и сам флаг, поэтому epoll-цикл может ждать его вместе с остальными дескрипторами.
+class ThreadFlag {
+public:
+    explicit ThreadFlag(bool use_eventfd = false) {
+        if (use_eventfd) {
+            _event.emplace();
+        }
+    }
+
+    void wait() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (!_flag) {
+            TRACE_WAIT_BEGIN(&_cv);
+            _cv.wait(l, [this]() { return _flag; });
+            TRACE_WAIT_END(&_cv);
+        }
+    }
+
+    bool is_set() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        return _flag;
+    }
+
+    void set_flag() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (_flag) {
+            return;
+        }
+        _flag = true;
+        if (_event) {
+            _event->signal();
+        }
+        TRACE_NOTIFY(&_cv);
+        _cv.notify_all();
+    }
+
+    int native_handle() const { return _event ? _event->fd() : -1; }
+
+private:
+    std::mutex _m;
+    std::condition_variable _cv;
+    bool _flag{};
+    std::optional<EventFd> _event;
+};
+
+// Ждёт готовности fd на чтение не дольше timeout, возвращает true, если fd готов
+bool wait_readable(int fd, std::chrono::milliseconds timeout) {
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+
+    epoll_event out{};
+    int n = ::epoll_wait(epfd, &out, 1, static_cast<int>(timeout.count()));
+    ::close(epfd);
+    return n == 1;
+}
+
+/*
+ * Тесты
+ */
+TEST(test_no_eventfd_by_default) {
+    ConcurrentFIFOQueue<int> queue;
+    EXPECT_EQ(queue.native_handle(), -1);
+
+    queue.push(1);
+    EXPECT_EQ(queue.pop(), 1);
+}
+
+TEST(test_push_makes_fd_readable) {
+    ConcurrentFIFOQueue<int> queue{true};
+    EXPECT_FALSE(wait_readable(queue.native_handle(), 0ms));
+
+    queue.push(1);
+    EXPECT_TRUE(wait_readable(queue.native_handle(), 0ms));
+
+    std::vector<int> out;
+    EXPECT_EQ(queue.try_pop_all(std::back_inserter(out)), 1u);
+    EXPECT_EQ(out[0], 1);
+
+    // После вычерпывания fd больше не готов
+    EXPECT_FALSE(wait_readable(queue.native_handle(), 0ms));
+    EXPECT_EQ(queue.try_pop_all(std::back_inserter(out)), 0u);
+}
+
+TEST(test_pop_clears_fd) {
+    ConcurrentFIFOQueue<int> queue{true};
+    queue.push(1);
+    queue.push(2);
+
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_TRUE(wait_readable(queue.native_handle(), 0ms));  // Ещё есть элемент
+
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_FALSE(wait_readable(queue.native_handle(), 0ms));
+
+    // Следующий переход из пустой в непустую снова взводит fd
+    queue.push(3);
+    EXPECT_TRUE(wait_readable(queue.native_handle(), 0ms));
+}
+
+TEST(test_notifications_are_coalesced) {
+    ConcurrentFIFOQueue<int> queue{true};
+    for (int i = 0; i < 10; ++i) {
+        queue.push(i);
+    }
+
+    // Счётчик eventfd показывает, сколько было записей: на всю пачку должна быть одна
+    uint64_t writes = 0;
+    EXPECT_EQ(::read(queue.native_handle(), &writes, sizeof(writes)), (ssize_t)sizeof(writes));
+    EXPECT_EQ(writes, 1u);
+}
+
+TEST(test_try_pop_all_keeps_order) {
+    ConcurrentFIFOQueue<int> queue{true};
+    for (int i = 0; i < 5; ++i) {
+        queue.push(i);
+    }
+
+    std::vector<int> out;
+    EXPECT_EQ(queue.try_pop_all(std::back_inserter(out)), 5u);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(out[i], i);
+    }
+}
+
+TEST(test_epoll_consumer) {
+    constexpr auto NumProducers = 4;
+    constexpr auto N = 1000;
+
+    ConcurrentFIFOQueue<int> queue{true};
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < NumProducers; ++t) {
+        producers.emplace_back([&, t]() {
+            for (int i = 0; i < N; ++i) {
+                queue.push(t * N + i);
+            }
+        });
+    }
+
+    // Потребитель - epoll-цикл без дополнительного потока-моста
+    std::vector<int> consumed;
+    while (consumed.size() < NumProducers * N) {
+        if (wait_readable(queue.native_handle(), 1000ms)) {
+            queue.try_pop_all(std::back_inserter(consumed));
+        }
+    }
+
+    for (auto& p : producers) {
+        p.join();
+    }
+
+    std::sort(consumed.begin(), consumed.end());
+    for (int i = 0; i < NumProducers * N; ++i) {
+        EXPECT_EQ(consumed[i], i);
+    }
+}
+
+TEST(test_flag_fd) {
+    ThreadFlag flag{true};
+    EXPECT_FALSE(wait_readable(flag.native_handle(), 0ms));
+
+    std::thread setter{[&]() {
+        std::this_thread::sleep_for(10ms);
+        flag.set_flag();
+    }};
+
+    EXPECT_TRUE(wait_readable(flag.native_handle(), 1000ms));
+    EXPECT_TRUE(flag.is_set());
+    flag.wait();  // Не должно заблокироваться
+
+    // Флаг устанавливается навсегда, fd остаётся готовым
+    EXPECT_TRUE(wait_readable(flag.native_handle(), 0ms));
+
+    setter.join();
+}
+
+int main() {
+    RUN_TESTS();
+    return 0;
+}
@@ -0,0 +1,530 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+#include "bench.h"
+
+using namespace std::chrono_literals;
+
+// Узел интрузивной очереди: пользовательский тип наследуется от MpscNode и сам владеет памятью.
+struct MpscNode {
+    std::atomic<MpscNode*> next{nullptr};
+};
+
+// Цепочка узлов, целиком отцепленная от очереди через pop_all.
+// Producer мог успеть обменять хвост, но ещё не записать ссылку на свой узел, поэтому итерация
+// при необходимости коротко ждёт появления ссылки. Следующий узел читается до выдачи текущего,
+// так что выданный узел можно сразу освобождать или переиспользовать.
+template <typename T>
+class MpscBatch {
+public:
+    MpscBatch() = default;
+    MpscBatch(MpscNode* first, MpscNode* last) : _next(first), _last(last) {}
+
+    bool empty() const { return _next == nullptr; }
+
+    // Возвращает следующий узел цепочки или nullptr, если цепочка закончилась
+    T* pop() {
+        MpscNode* node = _next;
+        if (!node) {
+            return nullptr;
+        }
+        if (node == _last) {
+            _next = nullptr;
+        } else {
+            MpscNode* next;
+            while (!(next = node->next.load(std::memory_order_acquire))) {
+                std::this_thread::yield();
+            }
+            _next = next;
+        }
+        return static_cast<T*>(node);
+    }
+
+private:
+    MpscNode* _next{};
+    MpscNode* _last{};
+};
+
+// MpscQueue - неограниченная интрузивная очередь "много производителей - один потребитель" (алгоритм Вьюкова).
+//
+// - push: один atomic exchange и один store, никаких lock'ов и ожиданий;
+// - pop / pop_all вызывает только один поток-потребитель; pop_all отцепляет всю цепочку за O(1);
+// - pop_wait паркует потребителя на condition variable, только когда очередь действительно пуста.
+//   Producer трогает mutex, лишь если потребитель припаркован.
+//
+// Порядок внутри одного producer'а сохраняется. pop может вернуть nullptr, даже если очередь не пуста:
+// producer обменял хвост, но ещё не связал узел. pop_wait в этом случае не засыпает, а уступает процессор.
+//
+// Пустой узел _stub либо стоит в начале цепочки (_tail == &_stub), либо не входит в неё вовсе:
+// потребитель возвращает его в очередь только на место хвоста (CAS в pop, exchange в pop_all).
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : _head(&_stub), _tail(&_stub) {}
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T* node) {
+        link(node);
+        if (_parked.load()) {
+            std::unique_lock l{_m};
+            TRACE_LOCK_ACQUIRED(&_m);
+            TRACE_NOTIFY(&_cv);
+            _cv.notify_one();
+        }
+    }
+
+    // Только для потребителя. Возвращает nullptr, если извлечь узел сейчас нельзя.
+    T* pop() {
+        MpscNode* tail = _tail;
+        MpscNode* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            _tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            _tail = next;
+            return static_cast<T*>(tail);
+        }
+
+        // tail похож на последний узел: ставим stub на место хвоста очереди. Если CAS не удался,
+        // producer посередине push и скоро свяжет tail со своим узлом.
+        _stub.next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* expected = tail;
+        if (_head.compare_exchange_strong(expected, &_stub)) {
+            _tail = &_stub;
+            return static_cast<T*>(tail);
+        }
+        return nullptr;
+    }
+
+    // Только для потребителя. Отцепляет все узлы разом, новые push'и попадут уже в следующую цепочку.
+    MpscBatch<T> pop_all() {
+        if (_tail == &_stub) {
+            MpscNode* next = _stub.next.load(std::memory_order_acquire);
+            if (!next) {
+                if (_head.load() == &_stub) {
+                    return {};
+                }
+                // Первый узел после stub'а вот-вот будет связан
+                while (!(next = _stub.next.load(std::memory_order_acquire))) {
+                    std::this_thread::yield();
+                }
+            }
+            _tail = next;
+        }
+
+        // stub больше не в цепочке, делаем его новым пустым хвостом
+        _stub.next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* last = _head.exchange(&_stub);
+        MpscNode* first = _tail;
+        _tail = &_stub;
+        return {first, last};
+    }
+
+    // Только для потребителя. Ждёт узел, засыпая, если очередь пуста.
+    T* pop_wait() {
+        for (;;) {
+            if (T* node = pop()) {
+                return node;
+            }
+            if (empty()) {
+                park();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Только для потребителя. Ждёт, пока в очереди что-нибудь появится.
+    void park() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        _parked.store(true);
+        // Dekker: либо мы увидим новый хвост, либо producer увидит _parked и разбудит нас под _m
+        while (empty()) {
+            TRACE_WAIT_BEGIN(&_cv);
+            _cv.wait(l);
+            TRACE_WAIT_END(&_cv);
+        }
+        _parked.store(false);
+    }
+
+    // Только для потребителя
+    bool empty() const {
+        return _tail == &_stub && !_stub.next.load(std::memory_order_acquire) && _head.load() == &_stub;
+    }
+
+private:
+    void link(MpscNode* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = _head.exchange(node);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    alignas(64) std::atomic<MpscNode*> _head;  // сюда добавляют producer'ы
+    alignas(64) MpscNode* _tail;               // отсюда читает потребитель
+    MpscNode _stub;
+
+    std::atomic<bool> _parked{false};
+    std::mutex _m;
+    std::condition_variable _cv;
+};
+
+template <typename T>
+class NodePool;
+
+// Узел, который можно вернуть в пул producer'а, выделившего его
+template <typename T>
+struct PooledNode : MpscNode {
+    NodePool<T>* owner{};
+};
+
+// NodePool - пул узлов одного producer'а. acquire вызывает только владелец, recycle - любой поток
+// (обычно потребитель после обработки). Возвращённые узлы копятся в lock-free стеке, и владелец забирает
+// их все одним exchange, когда кончается локальный список. Объекты не пересоздаются: acquire отдаёт
+// узел в том состоянии, в котором его вернули. Пул должен пережить все свои узлы.
+template <typename T>
+class NodePool {
+public:
+    NodePool() = default;
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ~NodePool() {
+        free_list(_local);
+        free_list(_returned.exchange(nullptr));
+    }
+
+    T* acquire() {
+        if (!_local) {
+            _local = static_cast<T*>(_returned.exchange(nullptr, std::memory_order_acquire));
+        }
+        if (!_local) {
+            T* node = new T{};
+            node->owner = this;
+            _allocated++;
+            return node;
+        }
+        T* node = _local;
+        _local = static_cast<T*>(node->next.load(std::memory_order_relaxed));
+        return node;
+    }
+
+    // node должен быть получен из acquire какого-либо пула
+    static void recycle(T* node) {
+        assert(node->owner && "NodePool::recycle: node was not acquired from a pool");
+        NodePool* pool = node->owner;
+        MpscNode* head = pool->_returned.load(std::memory_order_relaxed);
+        do {
+            node->next.store(head, std::memory_order_relaxed);
+        } while (!pool->_returned.compare_exchange_weak(head, node, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+    }
+
+    // Сколько узлов пул выделил за всё время
+    size_t allocated() const { return _allocated; }
+
+private:
+    static void free_list(MpscNode* node) {
+        while (node) {
+            MpscNode* next = node->next.load(std::memory_order_relaxed);
+            delete static_cast<T*>(node);
+            node = next;
+        }
+    }
+
+    T* _local{};
+    size_t _allocated{};
+    alignas(64) std::atomic<MpscNode*> _returned{nullptr};
+};
+
+struct Message : PooledNode<Message> {
+    int producer{};
+    int seq{};
+};
+
+// Очередь из task-4: один mutex на всех. Используется в бенчмарке.
+template <typename T>
+class ConcurrentFIFOQueue {
+public:
+    void push(const T& val) {
+        std::unique_lock l{_m};
+        _queue.push(val);
+        _not_empty_cv.notify_one();
+    }
+
+    T pop() {
+        std::unique_lock l{_m};
+        _not_empty_cv.wait(l, [this]() { return !_queue.empty(); });
+        T val = _queue.front();
+        _queue.pop();
+        return val;
+    }
+
+private:
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::queue<T> _queue;
+};
+
+/*
+ * Тесты
+ */
+TEST(test_push_pop) {
+    MpscQueue<Message> queue;
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(queue.pop() == nullptr);
+
+    std::vector<Message> msgs(3);
+    for (int i = 0; i < 3; ++i) {
+        msgs[i].seq = i;
+        queue.push(&msgs[i]);
+    }
+    EXPECT_FALSE(queue.empty());
+
+    for (int i = 0; i < 3; ++i) {
+        Message* m = queue.pop();
+        EXPECT_TRUE(m != nullptr);
+        EXPECT_EQ(m->seq, i);
+    }
+    EXPECT_TRUE(queue.pop() == nullptr);
+    EXPECT_TRUE(queue.empty());
+
+    // Узлы можно снова класть в очередь
+    queue.push(&msgs[1]);
+    EXPECT_EQ(queue.pop()->seq, 1);
+}
+
+TEST(test_pop_all) {
+    MpscQueue<Message> queue;
+    EXPECT_TRUE(queue.pop_all().empty());
+
+    std::vector<Message> msgs(10);
+    for (int i = 0; i < 5; ++i) {
+        msgs[i].seq = i;
+        queue.push(&msgs[i]);
+    }
+    // Часть узлов забрана по одному - pop_all должен отдать остаток
+    EXPECT_EQ(queue.pop()->seq, 0);
+
+    auto batch = queue.pop_all();
+    EXPECT_TRUE(queue.empty());
+    for (int i = 1; i < 5; ++i) {
+        EXPECT_EQ(batch.pop()->seq, i);
+    }
+    EXPECT_TRUE(batch.pop() == nullptr);
+
+    // После pop_all очередь продолжает работать
+    for (int i = 5; i < 10; ++i) {
+        msgs[i].seq = i;
+        queue.push(&msgs[i]);
+    }
+    batch = queue.pop_all();
+    for (int i = 5; i < 10; ++i) {
+        EXPECT_EQ(batch.pop()->seq, i);
+    }
+    EXPECT_TRUE(queue.pop() == nullptr);
+}
+
+TEST(test_consumer_parks) {
+    MpscQueue<Message> queue;
+    Message msg;
+    msg.seq = 42;
+    std::atomic_int got{0};
+
+    std::thread consumer{[&]() { got = queue.pop_wait()->seq; }};
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(got.load(), 0);
+
+    queue.push(&msg);
+    consumer.join();
+    EXPECT_EQ(got.load(), 42);
+}
+
+TEST(test_multiple_producers) {
+    constexpr int NumProducers = 8;
+    constexpr int N = 2000;
+
+    MpscQueue<Message> queue;
+    std::vector<std::vector<Message>> msgs(NumProducers);
+    for (auto& v : msgs) {
+        v = std::vector<Message>(N);
+    }
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < NumProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < N; ++i) {
+                msgs[p][i].producer = p;
+                msgs[p][i].seq = i;
+                queue.push(&msgs[p][i]);
+            }
+        });
+    }
+
+    // Потребитель чередует pop и pop_all; порядок внутри каждого producer'а должен сохраниться
+    std::vector<int> next_seq(NumProducers, 0);
+    int received = 0;
+    auto check = [&](Message* m) {
+        EXPECT_EQ(m->seq, next_seq[m->producer]);
+        next_seq[m->producer]++;
+        received++;
+    };
+    while (received < NumProducers * N) {
+        if (received % 3 == 0) {
+            auto batch = queue.pop_all();
+            while (Message* m = batch.pop()) {
+                check(m);
+            }
+        } else {
+            check(queue.pop_wait());
+        }
+    }
+
+    for (auto& t : producers) {
+        t.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(test_node_pool) {
+    constexpr int N = 1000;
+
+    MpscQueue<Message> queue;
+    NodePool<Message> pool;
+
+    std::thread producer{[&]() {
+        for (int i = 0; i < N; ++i) {
+            Message* m = pool.acquire();
+            m->seq = i;
+            queue.push(m);
+        }
+    }};
+
+    for (int i = 0; i < N; ++i) {
+        Message* m = queue.pop_wait();
+        EXPECT_EQ(m->seq, i);
+        NodePool<Message>::recycle(m);
+    }
+    producer.join();
+
+    // Все выделенные узлы теперь в пуле - столько же acquire подряд не выделяют новую память
+    size_t before = pool.allocated();
+    std::vector<Message*> nodes;
+    for (size_t i = 0; i < before; ++i) {
+        nodes.push_back(pool.acquire());
+    }
+    EXPECT_EQ(pool.allocated(), before);
+    for (Message* m : nodes) {
+        NodePool<Message>::recycle(m);
+    }
+}
+
+TEST(test_node_pool_reuses_node) {
+    MpscQueue<Message> queue;
+    NodePool<Message> pool;
+
+    // Узел возвращается до следующего acquire, поэтому на все сообщения хватает одного
+    for (int i = 0; i < 100; ++i) {
+        Message* m = pool.acquire();
+        m->seq = i;
+        queue.push(m);
+
+        Message* received = queue.pop();
+        EXPECT_TRUE(received == m);
+        EXPECT_EQ(received->seq, i);
+        NodePool<Message>::recycle(received);
+    }
+    EXPECT_EQ(pool.allocated(), 1u);
+}
+
+/*
+ * Бенчмарки
+ */
+BENCH(bench_mpsc_queue) {
+    constexpr int TotalMessages = 2000000;
+
+    for (int producers : {2, 4, 8, 16, 32, 64}) {
+        int per_producer = TotalMessages / producers;
+        std::vector<std::vector<Message>> msgs(producers);
+        for (auto& v : msgs) {
+            v = std::vector<Message>(per_producer);
+        }
+
+        {
+            ConcurrentFIFOQueue<Message*> queue;
+            auto elapsed = run_threads(producers + 1, [&](int idx) {
+                if (idx == producers) {
+                    for (int i = 0; i < per_producer * producers; ++i) {
+                        queue.pop();
+                    }
+                    return;
+                }
+                for (auto& m : msgs[idx]) {
+                    queue.push(&m);
+                }
+            });
+            report("mutex queue, producers", producers, size_t(per_producer) * producers, elapsed);
+        }
+
+        {
+            MpscQueue<Message> queue;
+            auto elapsed = run_threads(producers + 1, [&](int idx) {
+                if (idx == producers) {
+                    for (int i = 0; i < per_producer * producers; ++i) {
+                        queue.pop_wait();
+                    }
+                    return;
+                }
+                for (auto& m : msgs[idx]) {
+                    queue.push(&m);
+                }
+            });
+            report("mpsc queue, producers", producers, size_t(per_producer) * producers, elapsed);
+        }
+
+        {
+            MpscQueue<Message> queue;
+            auto elapsed = run_threads(producers + 1, [&](int idx) {
+                if (idx == producers) {
+                    int received = 0;
+                    while (received < per_producer * producers) {
+                        auto batch = queue.pop_all();
+                        while (batch.pop()) {
+                            received++;
+                        }
+                        if (received < per_producer * producers && queue.empty()) {
+                            queue.park();
+                        }
+                    }
+                    return;
+                }
+                for (auto& m : msgs[idx]) {
+                    queue.push(&m);
+                }
+            });
+            report("mpsc queue pop_all, producers", producers, size_t(per_producer) * producers, elapsed);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    RUN_BENCHES(argc, argv);
+    RUN_TESTS();
+    return 0;
+}
@@ -0,0 +1,552 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+#include "bench.h"
+
+using namespace std::chrono_literals;
+
+// Статистика очереди между стадиями. Пишется под mutex'ом очереди, читается после завершения конвейера.
+struct QueueStats {
+    std::string name;
+    size_t capacity{};
+    uint64_t batches{};
+    uint64_t occupancy_sum{};  // сумма заполненности, замеренной при каждом push
+    uint64_t max_occupancy{};
+    uint64_t full_waits{};   // сколько раз producer ждал места - медленный потребитель
+    uint64_t empty_waits{};  // сколько раз consumer ждал данных - медленный производитель
+};
+
+// Ограниченная очередь пачек по шаблону task-5 с поддержкой конца потока:
+// после close() pop отдаёт оставшееся, а затем возвращает false.
+template <typename T>
+class BatchQueue {
+public:
+    BatchQueue(size_t limit, QueueStats* stats) : _limit(limit), _stats(stats) { _stats->capacity = limit; }
+
+    void push(std::vector<T>&& batch) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (_queue.size() >= _limit) {
+            _stats->full_waits++;
+            TRACE_WAIT_BEGIN(&_not_full_cv);
+            _not_full_cv.wait(l, [this]() { return _queue.size() < _limit; });
+            TRACE_WAIT_END(&_not_full_cv);
+        }
+        _queue.push(std::move(batch));
+
+        _stats->batches++;
+        _stats->occupancy_sum += _queue.size();
+        _stats->max_occupancy = std::max<uint64_t>(_stats->max_occupancy, _queue.size());
+        TRACE_NOTIFY(&_not_empty_cv);
+        _not_empty_cv.notify_one();
+    }
+
+    bool pop(std::vector<T>& batch) {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        if (_queue.empty() && !_closed) {
+            _stats->empty_waits++;
+            TRACE_WAIT_BEGIN(&_not_empty_cv);
+            _not_empty_cv.wait(l, [this]() { return !_queue.empty() || _closed; });
+            TRACE_WAIT_END(&_not_empty_cv);
+        }
+        if (_queue.empty()) {
+            return false;
+        }
+        batch = std::move(_queue.front());
+        _queue.pop();
+        TRACE_NOTIFY(&_not_full_cv);
+        _not_full_cv.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        _closed = true;
+        TRACE_NOTIFY(&_not_empty_cv);
+        _not_empty_cv.notify_all();
+    }
+
+private:
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::condition_variable _not_full_cv;
+    std::queue<std::vector<T>> _queue;
+    size_t _limit;
+    bool _closed{};
+    QueueStats* _stats;
+};
+
+struct StageOptions {
+    size_t parallelism = 1;
+    size_t batch_size = 256;     // размер пачек, которые стадия отдаёт дальше
+    size_t queue_capacity = 8;   // ёмкость входной очереди стадии, в пачках
+    bool fuse = true;            // разрешить слияние с предыдущей стадией при равном parallelism
+};
+
+struct StageStats {
+    std::string name;
+    size_t parallelism{};
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> busy_ns{0};  // время внутри пользовательской функции, суммарно по потокам
+
+    void record(size_t n, std::chrono::steady_clock::duration busy) {
+        items += n;
+        busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count();
+    }
+};
+
+// Собранный конвейер: набор тел рабочих потоков и статистика. Создаётся через Pipeline<T>::sink.
+class PipelinePlan {
+public:
+    // Запускает все стадии и ждёт, пока конец потока не дойдёт до sink'а
+    void run() {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (auto& worker : _workers) {
+            threads.emplace_back(worker);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        _wall = std::chrono::steady_clock::now() - start;
+    }
+
+    const std::vector<std::unique_ptr<StageStats>>& stages() const { return _stages; }
+
+    const std::vector<std::unique_ptr<QueueStats>>& queues() const { return _queues; }
+
+    std::chrono::nanoseconds wall_time() const { return _wall; }
+
+    // Занятость стадии: доля времени, которое её потоки провели в пользовательской функции.
+    // У узкого места она близка к 100%, а его входная очередь почти всегда полна.
+    void print_stats(std::ostream& out) const {
+        double wall_ns = std::max<double>(1.0, static_cast<double>(_wall.count()));
+        for (auto& s : _stages) {
+            double busy = static_cast<double>(s->busy_ns.load()) / (wall_ns * static_cast<double>(s->parallelism));
+            out << "[stage] " << s->name << " x" << s->parallelism << ": " << s->items.load() << " items, "
+                << static_cast<double>(s->items.load()) * 1000.0 / wall_ns << " Mitems/s, busy "
+                << static_cast<int>(busy * 100) << "%\n";
+        }
+        for (auto& q : _queues) {
+            double avg = q->batches ? static_cast<double>(q->occupancy_sum) / static_cast<double>(q->batches) : 0.0;
+            out << "[queue] " << q->name << ": capacity " << q->capacity << ", avg " << avg << ", max "
+                << q->max_occupancy << ", full waits " << q->full_waits << ", empty waits " << q->empty_waits
+                << "\n";
+        }
+    }
+
+private:
+    template <typename>
+    friend class Pipeline;
+
+    StageStats* add_stage(const std::string& name, size_t parallelism) {
+        _stages.push_back(std::make_unique<StageStats>());
+        _stages.back()->name = name;
+        _stages.back()->parallelism = parallelism;
+        return _stages.back().get();
+    }
+
+    QueueStats* add_queue(const std::string& name) {
+        _queues.push_back(std::make_unique<QueueStats>());
+        _queues.back()->name = name;
+        return _queues.back().get();
+    }
+
+    std::vector<std::unique_ptr<StageStats>> _stages;
+    std::vector<std::unique_ptr<QueueStats>> _queues;
+    std::vector<std::function<void()>> _workers;
+    std::chrono::nanoseconds _wall{};
+};
+
+// Pipeline<T> - построитель конвейера, чья последняя стадия выдаёт элементы типа T:
+//
+//     auto plan = Pipeline<Line>::from("read", read_line, {1})
+//                     .then("parse", parse, {4})
+//                     .then("transform", transform, {4})
+//                     .sink("write", write, {1});
+//     plan->run();
+//
+// Соседние стадии с одинаковым parallelism (и fuse = true) сливаются: элементы передаются простым вызовом функции
+// в том же потоке, без очереди. Между остальными стадиями стоит BatchQueue, в которую кладутся пачки по batch_size
+// элементов, т.е. один lock/notify на пачку, а не на элемент.
+// Конец потока: когда source вернул std::nullopt, каждая группа стадий после завершения всех своих потоков
+// закрывает выходную очередь, и следующая группа завершается, вычерпав её.
+//
+// Объект source один на все потоки стадии: он вызывается из parallelism потоков одновременно
+// и при parallelism > 1 должен быть потокобезопасным.
+// Функции остальных стадий копируются в каждый рабочий поток.
+template <typename T>
+class Pipeline {
+public:
+    using Emit = std::function<void(std::vector<T>&)>;
+    // Тело рабочего потока группы слитых стадий: отдаёт результаты пачками в emit
+    using Body = std::function<void(const Emit&)>;
+
+    template <typename Source>
+    static Pipeline from(const std::string& name, Source source, StageOptions opts = {}) {
+        auto plan = std::make_shared<PipelinePlan>();
+        StageStats* stats = plan->add_stage(name, opts.parallelism);
+        size_t batch_size = opts.batch_size;
+        // Body копируется в каждый рабочий поток, а источник должен остаться общим
+        auto shared_source = std::make_shared<Source>(std::move(source));
+
+        Body body = [shared_source, stats, batch_size](const Emit& emit) {
+            std::vector<T> batch;
+            for (;;) {
+                batch.clear();
+                auto start = std::chrono::steady_clock::now();
+                while (batch.size() < batch_size) {
+                    std::optional<T> val = (*shared_source)();
+                    if (!val) {
+                        break;
+                    }
+                    batch.push_back(std::move(*val));
+                }
+                stats->record(batch.size(), std::chrono::steady_clock::now() - start);
+
+                if (batch.empty()) {
+                    return;
+                }
+                bool last = batch.size() < batch_size;
+                emit(batch);
+                if (last) {
+                    return;
+                }
+            }
+        };
+        return Pipeline{std::move(plan), std::move(body), opts.parallelism, opts.batch_size};
+    }
+
+    template <typename F, typename U = std::decay_t<std::invoke_result_t<F&, T&&>>>
+    Pipeline<U> then(const std::string& name, F fn, StageOptions opts = {}) {
+        Body input = connect(name, opts);
+        StageStats* stats = _plan->add_stage(name, opts.parallelism);
+
+        typename Pipeline<U>::Body body = [input, fn, stats](const typename Pipeline<U>::Emit& emit) {
+            F local_fn = fn;
+            std::vector<U> out;
+            input([&](std::vector<T>& batch) {
+                auto start = std::chrono::steady_clock::now();
+                out.clear();
+                out.reserve(batch.size());
+                for (auto& val : batch) {
+                    out.push_back(local_fn(std::move(val)));
+                }
+                stats->record(batch.size(), std::chrono::steady_clock::now() - start);
+                emit(out);
+            });
+        };
+        return Pipeline<U>{_plan, std::move(body), opts.parallelism, opts.batch_size};
+    }
+
+    // Завершает конвейер стадией-потребителем и возвращает готовый к запуску план
+    template <typename F>
+    std::shared_ptr<PipelinePlan> sink(const std::string& name, F fn, StageOptions opts = {}) {
+        Body input = connect(name, opts);
+        StageStats* stats = _plan->add_stage(name, opts.parallelism);
+
+        for (size_t i = 0; i < opts.parallelism; ++i) {
+            _plan->_workers.push_back([input, fn, stats]() {
+                F local_fn = fn;
+                input([&](std::vector<T>& batch) {
+                    auto start = std::chrono::steady_clock::now();
+                    for (auto& val : batch) {
+                        local_fn(std::move(val));
+                    }
+                    stats->record(batch.size(), std::chrono::steady_clock::now() - start);
+                });
+            });
+        }
+        return _plan;
+    }
+
+private:
+    template <typename>
+    friend class Pipeline;
+
+    Pipeline(std::shared_ptr<PipelinePlan> plan, Body body, size_t parallelism, size_t batch_size)
+        : _plan(std::move(plan)), _body(std::move(body)), _parallelism(parallelism), _batch_size(batch_size) {}
+
+    // Возвращает вход для следующей стадии: либо тело текущей группы (слияние),
+    // либо чтение из новой очереди, в которую потоки текущей группы пишут пачками.
+    Body connect(const std::string& next_name, const StageOptions& next) {
+        if (next.fuse && next.parallelism == _parallelism) {
+            return _body;
+        }
+
+        QueueStats* stats = _plan->add_queue(_plan->_stages.back()->name + " -> " + next_name);
+        auto queue = std::make_shared<BatchQueue<T>>(next.queue_capacity, stats);
+        auto running = std::make_shared<std::atomic<size_t>>(_parallelism);
+
+        for (size_t i = 0; i < _parallelism; ++i) {
+            _plan->_workers.push_back([body = _body, queue, running, batch_size = _batch_size]() {
+                std::vector<T> pending;
+                body([&](std::vector<T>& out) {
+                    if (pending.empty() && out.size() >= batch_size) {
+                        queue->push(std::move(out));
+                        out.clear();
+                        return;
+                    }
+                    for (auto& val : out) {
+                        pending.push_back(std::move(val));
+                        if (pending.size() >= batch_size) {
+                            queue->push(std::move(pending));
+                            pending.clear();
+                        }
+                    }
+                });
+                if (!pending.empty()) {
+                    queue->push(std::move(pending));
+                }
+                // Последний поток группы передаёт конец потока дальше
+                if (--*running == 0) {
+                    queue->close();
+                }
+            });
+        }
+
+        return [queue](const Emit& emit) {
+            std::vector<T> batch;
+            while (queue->pop(batch)) {
+                emit(batch);
+            }
+        };
+    }
+
+    std::shared_ptr<PipelinePlan> _plan;
+    Body _body;
+    size_t _parallelism;
+    size_t _batch_size;
+};
+
+// Источник чисел [0, n) для тестов и бенчмарка; потокобезопасный
+struct CountingSource {
+    explicit CountingSource(int n) : n(n) {}
+
+    std::shared_ptr<std::atomic<int>> next = std::make_shared<std::atomic<int>>(0);
+    int n;
+
+    std::optional<int> operator()() {
+        int val = (*next)++;
+        return val < n ? std::optional<int>{val} : std::nullopt;
+    }
+};
+
+/*
+ * Тесты
+ */
+TEST(test_fused_pipeline_keeps_order) {
+    constexpr int N = 1000;
+    std::vector<std::string> out;
+
+    auto plan = Pipeline<int>::from("read", CountingSource{N}, {1, 64})
+                    .then("square", [](int x) { return int64_t{x} * x; })
+                    .then("format", [](int64_t x) { return std::to_string(x); })
+                    .sink("write", [&](std::string s) { out.push_back(std::move(s)); });
+    plan->run();
+
+    // Все стадии однопоточные и слиты в одну группу без очередей
+    EXPECT_EQ(plan->queues().size(), 0u);
+    EXPECT_EQ(out.size(), size_t{N});
+    for (int i = 0; i < N; ++i) {
+        EXPECT(out[i] == std::to_string(int64_t{i} * i));
+    }
+}
+
+TEST(test_unfused_pipeline_keeps_order) {
+    constexpr int N = 1000;
+    std::vector<int> out;
+
+    StageOptions no_fuse;
+    no_fuse.batch_size = 10;
+    no_fuse.fuse = false;
+
+    auto plan = Pipeline<int>::from("read", CountingSource{N}, no_fuse)
+                    .then("inc", [](int x) { return x + 1; }, no_fuse)
+                    .sink("write", [&](int x) { out.push_back(x); }, no_fuse);
+    plan->run();
+
+    EXPECT_EQ(plan->queues().size(), 2u);
+    EXPECT_EQ(plan->queues()[0]->batches, uint64_t{N / 10});
+    EXPECT_EQ(out.size(), size_t{N});
+    for (int i = 0; i < N; ++i) {
+        EXPECT_EQ(out[i], i + 1);
+    }
+}
+
+TEST(test_parallel_stage) {
+    constexpr int N = 10000;
+    std::vector<int> out;
+
+    StageOptions parallel;
+    parallel.parallelism = 4;
+    parallel.batch_size = 32;
+
+    auto plan = Pipeline<int>::from("read", CountingSource{N})
+                    .then("double", [](int x) { return x * 2; }, parallel)
+                    .then("inc", [](int x) { return x + 1; }, parallel)  // Сливается с "double"
+                    .sink("write", [&](int x) { out.push_back(x); });
+    plan->run();
+
+    EXPECT_EQ(plan->queues().size(), 2u);
+    EXPECT_EQ(plan->stages().size(), 4u);
+    for (auto& stage : plan->stages()) {
+        EXPECT_EQ(stage->items.load(), uint64_t{N});
+    }
+
+    // С параллельной стадией порядок не гарантирован, но все элементы должны дойти ровно один раз
+    std::sort(out.begin(), out.end());
+    EXPECT_EQ(out.size(), size_t{N});
+    for (int i = 0; i < N; ++i) {
+        EXPECT_EQ(out[i], i * 2 + 1);
+    }
+}
+
+TEST(test_parallel_source) {
+    constexpr int N = 100;
+    std::vector<int> out;
+
+    // Состояние источника хранится в самой лямбде: все потоки стадии должны вызывать один и тот же объект
+    std::mutex m;
+    auto source = [&m, i = 0]() mutable -> std::optional<int> {
+        std::unique_lock l{m};
+        return i < N ? std::optional<int>{i++} : std::nullopt;
+    };
+
+    StageOptions parallel;
+    parallel.parallelism = 2;
+    parallel.batch_size = 8;
+
+    auto plan = Pipeline<int>::from("read", source, parallel)
+                    .sink("write", [&](int x) { out.push_back(x); });
+    plan->run();
+
+    std::sort(out.begin(), out.end());
+    EXPECT_EQ(out.size(), size_t{N});
+    for (int i = 0; i < N && i < static_cast<int>(out.size()); ++i) {
+        EXPECT_EQ(out[i], i);
+    }
+}
+
+TEST(test_empty_stream) {
+    int count = 0;
+
+    StageOptions parallel;
+    parallel.parallelism = 3;
+
+    auto plan = Pipeline<int>::from("read", CountingSource{0})
+                    .then("id", [](int x) { return x; }, parallel)
+                    .sink("write", [&](int) { count++; });
+    plan->run();
+
+    EXPECT_EQ(count, 0);
+}
+
+/*
+ * Бенчмарки
+ */
+
+// Наивная передача по одному элементу: ConcurrentFIFOQueue из task-5 (nullopt - конец потока)
+template <typename T>
+class ItemQueue {
+public:
+    explicit ItemQueue(size_t limit) : _limit(limit) {}
+
+    void push(std::optional<T> val) {
+        std::unique_lock l{_m};
+        _not_full_cv.wait(l, [this]() { return _queue.size() < _limit; });
+        _queue.push(std::move(val));
+        _not_empty_cv.notify_one();
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock l{_m};
+        _not_empty_cv.wait(l, [this]() { return !_queue.empty(); });
+        auto val = std::move(_queue.front());
+        _queue.pop();
+        _not_full_cv.notify_one();
+        return val;
+    }
+
+private:
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::condition_variable _not_full_cv;
+    std::queue<std::optional<T>> _queue;
+    size_t _limit;
+};
+
+BENCH(bench_pipeline) {
+    constexpr int N = 2000000;
+    auto parse = [](int x) { return x * 2; };
+    auto transform = [](int x) { return x + 1; };
+
+    {
+        ItemQueue<int> q1{1024}, q2{1024}, q3{1024};
+        int64_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::thread read{[&]() {
+            for (int i = 0; i < N; ++i) {
+                q1.push(i);
+            }
+            q1.push(std::nullopt);
+        }};
+        std::thread parse_thread{[&]() {
+            while (auto v = q1.pop()) {
+                q2.push(parse(*v));
+            }
+            q2.push(std::nullopt);
+        }};
+        std::thread transform_thread{[&]() {
+            while (auto v = q2.pop()) {
+                q3.push(transform(*v));
+            }
+            q3.push(std::nullopt);
+        }};
+        while (auto v = q3.pop()) {
+            sum += *v;
+        }
+        read.join();
+        parse_thread.join();
+        transform_thread.join();
+        report("naive per-item chaining", 4, N, std::chrono::steady_clock::now() - start);
+    }
+
+    for (bool fuse : {false, true}) {
+        StageOptions opts;
+        opts.fuse = fuse;
+        int64_t sum = 0;
+        auto plan = Pipeline<int>::from("read", CountingSource{N}, opts)
+                        .then("parse", parse, opts)
+                        .then("transform", transform, opts)
+                        .sink("write", [&](int x) { sum += x; }, opts);
+        plan->run();
+        report(fuse ? "batched pipeline, fused" : "batched pipeline, queue per stage", fuse ? 1 : 4, N,
+               plan->wall_time());
+        if (!fuse) {
+            plan->print_stats(std::cout);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    RUN_BENCHES(argc, argv);
+    RUN_TESTS();
+    return 0;
+}
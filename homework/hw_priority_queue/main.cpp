@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+#include "bench.h"
+
+using namespace std::chrono_literals;
+
+// ConcurrentPriorityQueue - блокирующая очередь с приоритетами и той же семантикой, что у ConcurrentFIFOQueue:
+// pop ждёт появления элемента, push ждёт места, если задан лимит.
+//
+// Внутри это relaxed multi-queue: несколько куч (шардов), каждая под своим mutex'ом.
+// - push кладёт элемент в случайный шард;
+// - pop смотрит вершины двух случайных шардов и забирает лучшую.
+// Потоки почти не конкурируют за один lock, но порядок выдачи приблизительный: pop может вернуть
+// не самый приоритетный элемент очереди, а лишь один из самых приоритетных.
+// В strict режиме используется один шард, и порядок строгий (как у std::priority_queue под lock'ом).
+// Если две случайные пары шардов подряд оказались пустыми (элементов мало, шардов много), pop обходит
+// шарды по порядку, чтобы не перебирать пары наугад.
+//
+// Счётчик _items - это "билеты" на извлечение: он увеличивается только после вставки элемента в шард,
+// поэтому получивший билет pop гарантированно найдёт элемент в одном из шардов.
+template <typename T, typename Compare = std::less<T>>
+class ConcurrentPriorityQueue {
+public:
+    enum class Mode { Relaxed, Strict };
+
+    explicit ConcurrentPriorityQueue(size_t limit = 0, Mode mode = Mode::Relaxed, size_t num_shards = 0)
+        : _limit(limit) {
+        if (mode == Mode::Strict) {
+            num_shards = 1;
+        } else if (num_shards == 0) {
+            num_shards = std::clamp(4 * std::thread::hardware_concurrency(), 2u, MaxDefaultShards);
+        }
+        _num_shards = num_shards;
+        _shards = std::make_unique<Shard[]>(_num_shards);
+    }
+
+    void push(const T& val) { emplace(T{val}); }
+
+    void push(T&& val) { emplace(std::move(val)); }
+
+    T pop() {
+        acquire(_items, _not_empty_cv, _empty_sleepers);
+        T val = take_any();
+        if (_limit) {
+            release(_free_places, _not_full_cv, _full_sleepers);
+        }
+        return val;
+    }
+
+    // Не блокируется, возвращает false, если очередь пуста
+    bool try_pop(T& out) {
+        if (!try_acquire(_items)) {
+            return false;
+        }
+        out = take_any();
+        if (_limit) {
+            release(_free_places, _not_full_cv, _full_sleepers);
+        }
+        return true;
+    }
+
+    size_t size() const { return static_cast<size_t>(std::max<int64_t>(_items.load(), 0)); }
+
+private:
+    static constexpr unsigned MaxDefaultShards = 64;
+    static constexpr int RandomProbes = 2;
+
+    struct alignas(64) Shard {
+        std::mutex m;
+        std::vector<T> heap;
+    };
+
+    void emplace(T&& val) {
+        if (_limit) {
+            acquire(_free_places, _not_full_cv, _full_sleepers);
+        }
+
+        Shard& shard = _shards[random_shard()];
+        {
+            std::unique_lock l{shard.m};
+            TRACE_LOCK_ACQUIRED(&shard.m);
+            shard.heap.push_back(std::move(val));
+            std::push_heap(shard.heap.begin(), shard.heap.end(), _cmp);
+        }
+
+        release(_items, _not_empty_cv, _empty_sleepers);
+    }
+
+    // Извлекает элемент, на который уже взят билет
+    T take_any() {
+        for (int probe = 0; probe < RandomProbes; ++probe) {
+            size_t i = random_shard();
+            size_t j = random_shard();
+            if (i == j) {
+                j = (i + 1) % _num_shards;
+            }
+            if (i > j) {
+                std::swap(i, j);
+            }
+
+            // Шарды блокируются в порядке возрастания индекса, поэтому взаимоблокировки нет
+            Shard& a = _shards[i];
+            Shard& b = _shards[j];
+            std::unique_lock la{a.m};
+            TRACE_LOCK_ACQUIRED(&a.m);
+            std::unique_lock lb{b.m, std::defer_lock};
+            if (i != j) {
+                lb.lock();
+                TRACE_LOCK_ACQUIRED(&b.m);
+            }
+
+            Shard* best = nullptr;
+            if (!a.heap.empty()) {
+                best = &a;
+            }
+            if (i != j && !b.heap.empty() && (!best || _cmp(best->heap.front(), b.heap.front()))) {
+                best = &b;
+            }
+            if (best) {
+                return pop_top(*best);
+            }
+        }
+
+        // Элемент где-то есть, но случайные пары пусты - ищем линейно. Пока идёт обход, элемент могли
+        // забрать из ещё не просмотренного шарда, а новый положить в уже просмотренный, поэтому обход повторяется.
+        size_t start = random_shard();
+        for (;;) {
+            for (size_t k = 0; k < _num_shards; ++k) {
+                Shard& shard = _shards[(start + k) % _num_shards];
+                std::unique_lock l{shard.m};
+                TRACE_LOCK_ACQUIRED(&shard.m);
+                if (!shard.heap.empty()) {
+                    return pop_top(shard);
+                }
+            }
+        }
+    }
+
+    T pop_top(Shard& shard) {
+        std::pop_heap(shard.heap.begin(), shard.heap.end(), _cmp);
+        T val = std::move(shard.heap.back());
+        shard.heap.pop_back();
+        return val;
+    }
+
+    size_t random_shard() {
+        if (_num_shards == 1) {
+            return 0;
+        }
+        thread_local std::minstd_rand rng{std::random_device{}()};
+        return rng() % _num_shards;
+    }
+
+    static bool try_acquire(std::atomic<int64_t>& counter) {
+        int64_t n = counter.load();
+        while (n > 0) {
+            if (counter.compare_exchange_weak(n, n - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Берёт единицу из counter, засыпая на cv, пока счётчик нулевой.
+    // sleepers позволяет release не трогать mutex, когда никто не спит.
+    void acquire(std::atomic<int64_t>& counter, std::condition_variable& cv, std::atomic<int>& sleepers) {
+        if (try_acquire(counter)) {
+            return;
+        }
+        std::unique_lock l{_wait_m};
+        TRACE_LOCK_ACQUIRED(&_wait_m);
+        sleepers++;
+        while (!try_acquire(counter)) {
+            TRACE_WAIT_BEGIN(&cv);
+            cv.wait(l);
+            TRACE_WAIT_END(&cv);
+        }
+        sleepers--;
+    }
+
+    void release(std::atomic<int64_t>& counter, std::condition_variable& cv, std::atomic<int>& sleepers) {
+        counter++;
+        if (sleepers.load() > 0) {
+            std::unique_lock l{_wait_m};
+            TRACE_LOCK_ACQUIRED(&_wait_m);
+            TRACE_NOTIFY(&cv);
+            cv.notify_one();
+        }
+    }
+
+    size_t _limit;
+    size_t _num_shards;
+    std::unique_ptr<Shard[]> _shards;
+    Compare _cmp;
+
+    std::atomic<int64_t> _items{0};
+    std::atomic<int64_t> _free_places{static_cast<int64_t>(_limit)};
+
+    std::mutex _wait_m;
+    std::condition_variable _not_empty_cv;
+    std::condition_variable _not_full_cv;
+    std::atomic<int> _empty_sleepers{0};
+    std::atomic<int> _full_sleepers{0};
+};
+
+// Очередь с приоритетами по шаблону task-4: std::priority_queue под одним mutex'ом. Используется в бенчмарке.
+template <typename T>
+class LockedPriorityQueue {
+public:
+    void push(const T& val) {
+        std::unique_lock l{_m};
+        _queue.push(val);
+        _not_empty_cv.notify_one();
+    }
+
+    T pop() {
+        std::unique_lock l{_m};
+        _not_empty_cv.wait(l, [this]() { return !_queue.empty(); });
+        T val = _queue.top();
+        _queue.pop();
+        return val;
+    }
+
+private:
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::priority_queue<T> _queue;
+};
+
+/*
+ * Тесты
+ */
+TEST(test_strict_order) {
+    ConcurrentPriorityQueue<int> queue{0, ConcurrentPriorityQueue<int>::Mode::Strict};
+
+    queue.push(2);
+    queue.push(5);
+    queue.push(1);
+    queue.push(4);
+    EXPECT_EQ(queue.pop(), 5);
+    EXPECT_EQ(queue.pop(), 4);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_EQ(queue.pop(), 1);
+}
+
+TEST(test_custom_compare) {
+    ConcurrentPriorityQueue<int, std::greater<int>> queue{0, ConcurrentPriorityQueue<int, std::greater<int>>::Mode::Strict};
+
+    queue.push(3);
+    queue.push(1);
+    queue.push(2);
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_EQ(queue.pop(), 3);
+}
+
+TEST(test_relaxed_returns_everything) {
+    constexpr int N = 1000;
+    // Шардов фиксированное число, иначе на многоядерной машине в каждом окажется по паре элементов
+    ConcurrentPriorityQueue<int> queue{0, ConcurrentPriorityQueue<int>::Mode::Relaxed, 4};
+
+    for (int i = 0; i < N; ++i) {
+        queue.push(i);
+    }
+    EXPECT_EQ(queue.size(), size_t{N});
+
+    std::vector<int> popped;
+    int val = 0;
+    while (queue.try_pop(val)) {
+        popped.push_back(val);
+    }
+    EXPECT_EQ(popped.size(), size_t{N});
+
+    // Порядок приблизительный, но первый извлечённый элемент должен быть из верхней части
+    EXPECT_GT(popped.front(), N / 2);
+
+    std::sort(popped.begin(), popped.end());
+    for (int i = 0; i < N; ++i) {
+        EXPECT_EQ(popped[i], i);
+    }
+}
+
+TEST(test_few_items_many_shards) {
+    ConcurrentPriorityQueue<int> queue{0, ConcurrentPriorityQueue<int>::Mode::Relaxed, 256};
+
+    for (int i = 0; i < 100; ++i) {
+        queue.push(i);
+        int val = -1;
+        EXPECT_TRUE(queue.try_pop(val));
+        EXPECT_EQ(val, i);
+    }
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(test_pop_wait) {
+    ConcurrentPriorityQueue<int> queue;
+    std::atomic<bool> item_popped{false};
+
+    std::thread consumer{[&]() {
+        queue.pop();
+        item_popped.store(true);
+    }};
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(item_popped.load());
+
+    queue.push(1);
+    consumer.join();
+
+    EXPECT_TRUE(item_popped.load());
+}
+
+TEST(test_push_wait) {
+    constexpr auto Limit = 2u;
+    ConcurrentPriorityQueue<int> queue{Limit};
+
+    std::atomic_int values_pushed{0};
+
+    std::thread producer([&]() {
+        for (unsigned i = 0; i < Limit + 1; ++i) {
+            queue.push(i);
+            values_pushed++;
+        }
+    });
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(values_pushed.load(), Limit);
+
+    queue.pop();
+    producer.join();
+
+    EXPECT_EQ(values_pushed.load(), Limit + 1);
+}
+
+TEST(test_multiple_threads) {
+    constexpr auto NumThreads = 4;
+    constexpr auto N = 1000;
+
+    ConcurrentPriorityQueue<int> queue{8};
+
+    std::vector<int> consumed;
+    std::mutex consumed_mutex;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NumThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < N; ++i) {
+                queue.push(t * N + i);
+            }
+        });
+        threads.emplace_back([&]() {
+            for (int i = 0; i < N; ++i) {
+                int num = queue.pop();
+                std::lock_guard<std::mutex> lock(consumed_mutex);
+                consumed.push_back(num);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(consumed.size(), size_t{N * NumThreads});
+    std::sort(consumed.begin(), consumed.end());
+    for (int i = 0; i < N * NumThreads; ++i) {
+        EXPECT_EQ(consumed[i], i);
+    }
+}
+
+/*
+ * Бенчмарки
+ */
+template <typename Queue>
+void bench_push_pop(const std::string& name, Queue& queue, int num_threads) {
+    constexpr int OpsPerThread = 200000;
+
+    // Каждый поток чередует push и pop, очередь заранее заполнена, чтобы pop не засыпал
+    for (int i = 0; i < 1024; ++i) {
+        queue.push(i);
+    }
+    auto elapsed = run_threads(num_threads, [&](int idx) {
+        std::minstd_rand rng(idx + 1);
+        for (int i = 0; i < OpsPerThread / 2; ++i) {
+            queue.push(static_cast<int>(rng()));
+            queue.pop();
+        }
+    });
+    report(name, num_threads, size_t{OpsPerThread} * num_threads, elapsed);
+}
+
+BENCH(bench_priority_queues) {
+    for (int threads : BenchThreadCounts) {
+        LockedPriorityQueue<int> locked;
+        bench_push_pop("locked std::priority_queue", locked, threads);
+
+        ConcurrentPriorityQueue<int> strict{0, ConcurrentPriorityQueue<int>::Mode::Strict};
+        bench_push_pop("ConcurrentPriorityQueue strict", strict, threads);
+
+        ConcurrentPriorityQueue<int> relaxed{0, ConcurrentPriorityQueue<int>::Mode::Relaxed,
+                                             static_cast<size_t>(std::max(2, 4 * threads))};
+        bench_push_pop("ConcurrentPriorityQueue relaxed", relaxed, threads);
+    }
+}
+
+int main(int argc, char** argv) {
+    RUN_BENCHES(argc, argv);
+    RUN_TESTS();
+    return 0;
+}
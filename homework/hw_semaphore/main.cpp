@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+#include "bench.h"
+
+using namespace std::chrono_literals;
+
+// CountingSemaphore - счётчик разрешений (permits). acquire(n) ждёт, пока не наберётся n разрешений, release(n) возвращает их.
+//
+// Состояние - одно атомарное слово: число разрешений и флаг "есть ожидающие".
+// - Пока ожидающих нет, acquire/release - это один CAS, mutex не трогается.
+// - Если флаг выставлен, все изменения идут под mutex'ом: release раздаёт разрешения ожидающим строго по очереди
+//   и будит не больше одного потока на каждое выданное разрешение. Новый acquire не может обогнать ожидающих.
+class CountingSemaphore {
+public:
+    explicit CountingSemaphore(int64_t permits = 0) : _state(permits) {}
+
+    void acquire(int64_t n = 1) {
+        if (try_acquire(n)) {
+            return;
+        }
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        Waiter w{n};
+        if (enqueue_or_take(w)) {
+            return;
+        }
+        TRACE_WAIT_BEGIN(&w);
+        w.cv.wait(l, [&w]() { return w.granted; });
+        TRACE_WAIT_END(&w);
+    }
+
+    // Не блокируется, возвращает true, если удалось взять n разрешений
+    bool try_acquire(int64_t n = 1) {
+        int64_t s = _state.load(std::memory_order_relaxed);
+        while (!(s & HasWaiters) && s >= n) {
+            if (_state.compare_exchange_weak(s, s - n, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Rep, typename Period>
+    bool try_acquire_for(int64_t n, std::chrono::duration<Rep, Period> timeout) {
+        if (try_acquire(n)) {
+            return true;
+        }
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        Waiter w{n};
+        if (enqueue_or_take(w)) {
+            return true;
+        }
+        TRACE_WAIT_BEGIN(&w);
+        bool granted = w.cv.wait_until(l, deadline, [&w]() { return w.granted; });
+        TRACE_WAIT_END(&w);
+        if (granted) {
+            return true;
+        }
+
+        // Таймаут: уходим из очереди. Если мы были головой, следующим может уже хватать разрешений.
+        _waiters.erase(std::find(_waiters.begin(), _waiters.end(), &w));
+        dispatch(_state.load() & ~HasWaiters);
+        return false;
+    }
+
+    void release(int64_t n = 1) {
+        if (try_release(n)) {
+            return;
+        }
+
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        // Пока мы ждали _m, ожидающих могли раздать, и флаг снят - тогда fast path'ы снова меняют state
+        // конкурентно, и простая запись в dispatch затёрла бы их. Флаг ставится и снимается только под _m,
+        // поэтому если сейчас он снят, CAS гарантированно пройдёт без него.
+        if (!try_release(n)) {
+            dispatch((_state.load() & ~HasWaiters) + n);
+        }
+    }
+
+    // Текущее число свободных разрешений
+    int64_t available() const { return _state.load() & ~HasWaiters; }
+
+private:
+    static constexpr int64_t HasWaiters = int64_t{1} << 62;
+
+    struct Waiter {
+        explicit Waiter(int64_t n) : n(n) {}
+
+        int64_t n;
+        std::condition_variable cv;
+        bool granted{};
+    };
+
+    // Возвращает permits без lock'а, если флаг не выставлен
+    bool try_release(int64_t n) {
+        int64_t s = _state.load(std::memory_order_relaxed);
+        while (!(s & HasWaiters)) {
+            if (_state.compare_exchange_weak(s, s + n, std::memory_order_release, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Вызывается под _m. Либо забирает разрешения сразу, либо ставит флаг и встаёт в очередь.
+    bool enqueue_or_take(Waiter& w) {
+        int64_t s = _state.load();
+        for (;;) {
+            if (!(s & HasWaiters) && s >= w.n) {
+                if (_state.compare_exchange_weak(s, s - w.n)) {
+                    return true;
+                }
+            } else if (_state.compare_exchange_weak(s, s | HasWaiters)) {
+                _waiters.push_back(&w);
+                return false;
+            }
+        }
+    }
+
+    // Вызывается под _m при выставленном флаге: раздаёт permits по очереди, пока хватает голове.
+    void dispatch(int64_t permits) {
+        while (!_waiters.empty() && _waiters.front()->n <= permits) {
+            Waiter* w = _waiters.front();
+            _waiters.pop_front();
+            permits -= w->n;
+            w->granted = true;
+            TRACE_NOTIFY(w);
+            w->cv.notify_one();
+        }
+        // Пока флаг выставлен, fast path'ы state не меняют, поэтому достаточно простой записи
+        _state.store(_waiters.empty() ? permits : permits | HasWaiters);
+    }
+
+    std::atomic<int64_t> _state;
+    std::mutex _m;
+    std::deque<Waiter*> _waiters;
+};
+
+// Ограниченная очередь из task-5, в которой учёт "есть место" / "есть элемент" вынесен в два семафора.
+// Mutex защищает только сам контейнер, и ни push, ни pop не ждут на нём.
+template <typename T>
+class ConcurrentFIFOQueue {
+public:
+    explicit ConcurrentFIFOQueue(size_t limit = 0) : _limit(limit), _free_places(static_cast<int64_t>(limit)) {}
+
+    void push(const T& val) {
+        if (_limit) {
+            _free_places.acquire();
+        }
+        {
+            std::unique_lock l{_m};
+            TRACE_LOCK_ACQUIRED(&_m);
+            _queue.push(val);
+        }
+        _items.release();
+    }
+
+    T pop() {
+        _items.acquire();
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        T val = std::move(_queue.front());
+        _queue.pop();
+        l.unlock();
+
+        if (_limit) {
+            _free_places.release();
+        }
+        return val;
+    }
+
+private:
+    size_t _limit;
+    CountingSemaphore _free_places;
+    CountingSemaphore _items;
+
+    std::mutex _m;
+    std::queue<T> _queue;
+};
+
+// Ограниченная очередь по шаблону task-5: один mutex и два condition variable. Используется в бенчмарке.
+template <typename T>
+class MutexFIFOQueue {
+public:
+    explicit MutexFIFOQueue(size_t limit = 0) : _limit(limit) {}
+
+    void push(const T& val) {
+        std::unique_lock l{_m};
+        _not_full_cv.wait(l, [this]() { return !_limit || _queue.size() < _limit; });
+        _queue.push(val);
+        _not_empty_cv.notify_one();
+    }
+
+    T pop() {
+        std::unique_lock l{_m};
+        _not_empty_cv.wait(l, [this]() { return !_queue.empty(); });
+        T val = std::move(_queue.front());
+        _queue.pop();
+        _not_full_cv.notify_one();
+        return val;
+    }
+
+private:
+    std::mutex _m;
+    std::condition_variable _not_empty_cv;
+    std::condition_variable _not_full_cv;
+    std::queue<T> _queue;
+    size_t _limit;
+};
+
+/*
+ * Тесты
+ */
+TEST(test_acquire_release) {
+    CountingSemaphore sem{3};
+
+    sem.acquire(2);
+    EXPECT_EQ(sem.available(), 1);
+    EXPECT_FALSE(sem.try_acquire(2));
+    EXPECT_TRUE(sem.try_acquire(1));
+    EXPECT_EQ(sem.available(), 0);
+
+    sem.release(3);
+    EXPECT_EQ(sem.available(), 3);
+}
+
+TEST(test_acquire_waits) {
+    CountingSemaphore sem{0};
+    std::atomic_bool acquired{false};
+
+    std::thread waiter{[&]() {
+        sem.acquire(2);
+        acquired = true;
+    }};
+
+    std::this_thread::sleep_for(10ms);
+    sem.release(1);
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(acquired.load());  // Одного разрешения недостаточно
+
+    sem.release(1);
+    waiter.join();
+    EXPECT_TRUE(acquired.load());
+    EXPECT_EQ(sem.available(), 0);
+}
+
+TEST(test_try_acquire_for) {
+    CountingSemaphore sem{1};
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(sem.try_acquire_for(2, 20ms));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 20ms);
+    EXPECT_EQ(sem.available(), 1);
+
+    // После таймаута семафор продолжает работать в fast path
+    EXPECT_TRUE(sem.try_acquire_for(1, 20ms));
+    EXPECT_EQ(sem.available(), 0);
+}
+
+TEST(test_timed_out_head_unblocks_next) {
+    CountingSemaphore sem{1};
+    std::atomic_bool small_acquired{false};
+
+    // Голова очереди хочет 5 разрешений и по таймауту уходит - стоящий за ней должен получить своё
+    std::thread big{[&]() { sem.try_acquire_for(5, 30ms); }};
+    std::this_thread::sleep_for(10ms);
+
+    std::thread small{[&]() {
+        sem.acquire(1);
+        small_acquired = true;
+    }};
+    std::this_thread::sleep_for(10ms);
+    EXPECT_FALSE(small_acquired.load());  // Не обгоняет ожидающего
+
+    big.join();
+    small.join();
+    EXPECT_TRUE(small_acquired.load());
+}
+
+TEST(test_release_wakes_in_fifo_order) {
+    constexpr int NumThreads = 4;
+    CountingSemaphore sem{0};
+
+    std::vector<int> order;
+    std::mutex order_mutex;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NumThreads; ++i) {
+        threads.emplace_back([&, i]() {
+            sem.acquire();
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        });
+        // Гарантируем порядок постановки в очередь
+        std::this_thread::sleep_for(5ms);
+    }
+
+    for (int i = 0; i < NumThreads; ++i) {
+        sem.release();
+        std::this_thread::sleep_for(5ms);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (int i = 0; i < NumThreads; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+TEST(test_permits_conserved) {
+    constexpr int64_t Permits = 4;
+    constexpr auto NumThreads = 8;
+    constexpr auto N = 500;
+
+    CountingSemaphore sem{Permits};
+    std::atomic<int64_t> held{0};
+    std::atomic<int64_t> max_held{0};
+
+    // Потоки вперемешку берут 1-3 разрешения через acquire и try_acquire_for и возвращают их.
+    // Потерянное разрешение изменит available() в конце, выданное дважды - превысит Permits.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NumThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < N; ++i) {
+                int64_t n = 1 + (t + i) % 3;
+                if ((t + i) % 2 == 0) {
+                    sem.acquire(n);
+                } else if (!sem.try_acquire_for(n, 50us)) {
+                    continue;
+                }
+
+                int64_t now = held += n;
+                int64_t prev = max_held.load();
+                while (now > prev && !max_held.compare_exchange_weak(prev, now)) {
+                }
+                held -= n;
+                sem.release(n);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_LE(max_held.load(), Permits);
+    EXPECT_EQ(sem.available(), Permits);
+}
+
+TEST(test_queue_push_wait) {
+    constexpr auto Limit = 2u;
+    ConcurrentFIFOQueue<int> queue{Limit};
+
+    std::atomic_int values_pushed{0};
+
+    std::thread producer([&]() {
+        for (unsigned i = 0; i < Limit + 1; ++i) {
+            queue.push(i);
+            values_pushed++;
+        }
+    });
+
+    std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(values_pushed.load(), Limit);
+
+    EXPECT_EQ(queue.pop(), 0);
+    producer.join();
+
+    EXPECT_EQ(values_pushed.load(), Limit + 1);
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+}
+
+TEST(test_queue_multiple_threads) {
+    constexpr auto NumThreads = 4;
+    constexpr auto N = 1000;
+
+    ConcurrentFIFOQueue<int> queue{2};
+
+    std::vector<int> consumed;
+    std::mutex consumed_mutex;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NumThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < N; ++i) {
+                queue.push(t * N + i);
+            }
+        });
+        threads.emplace_back([&]() {
+            for (int i = 0; i < N; ++i) {
+                int num = queue.pop();
+                std::lock_guard<std::mutex> lock(consumed_mutex);
+                consumed.push_back(num);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(consumed.size(), size_t{N * NumThreads});
+    std::sort(consumed.begin(), consumed.end());
+    for (int i = 0; i < N * NumThreads; ++i) {
+        EXPECT_EQ(consumed[i], i);
+    }
+}
+
+/*
+ * Бенчмарки
+ */
+template <typename Queue>
+void bench_bounded_queue(const std::string& name, int num_threads) {
+    constexpr int ItemsPerProducer = 200000;
+
+    // Половина потоков - producer'ы, половина - consumer'ы
+    Queue queue{64};
+    int producers = num_threads / 2;
+    auto elapsed = run_threads(num_threads, [&](int idx) {
+        for (int i = 0; i < ItemsPerProducer; ++i) {
+            if (idx % 2 == 0) {
+                queue.push(i);
+            } else {
+                queue.pop();
+            }
+        }
+    });
+    report(name, num_threads, size_t{ItemsPerProducer} * producers, elapsed);
+}
+
+BENCH(bench_semaphore_queue) {
+    for (int threads : BenchThreadCounts) {
+        // Нужен хотя бы один producer и один consumer
+        if (threads < 2) {
+            continue;
+        }
+        bench_bounded_queue<MutexFIFOQueue<int>>("mutex + 2 cv queue", threads);
+        bench_bounded_queue<ConcurrentFIFOQueue<int>>("semaphore queue", threads);
+    }
+}
+
+int main(int argc, char** argv) {
+    RUN_BENCHES(argc, argv);
+    RUN_TESTS();
+    return 0;
+}
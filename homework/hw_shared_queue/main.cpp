@@ -0,0 +1,521 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "tests.h"
+
+using namespace std::chrono_literals;
+
+// SharedFIFOQueue - ограниченная FIFO очередь (как ConcurrentFIFOQueue из task-5), целиком лежащая
+// в разделяемой памяти (shm_open + mmap), чтобы producer и consumer могли быть разными процессами.
+//
+// Требования:
+// - элементы тривиально копируемые, т.к. копируются в кольцевой буфер побайтно;
+// - mutex и condition variable процесс-разделяемые (PTHREAD_PROCESS_SHARED);
+// - mutex robust: если процесс умер, держа lock, следующий захвативший получает EOWNERDEAD
+//   и восстанавливает очередь;
+// - при attach проверяются magic, версия и раскладка (размер заголовка, размер/выравнивание элемента, ёмкость).
+//   Размер заголовка зависит от размеров pthread-типов, поэтому участник, собранный с другим ABI, отвергается.
+//
+// Чтобы смерть процесса в любой момент оставляла очередь согласованной, состояние кольца - это только
+// два монотонных счётчика head и tail: элемент сначала копируется в слот, и лишь потом одной записью
+// публикуется сдвигом tail (аналогично для pop и head).
+template <typename T>
+class SharedFIFOQueue {
+    static_assert(std::is_trivially_copyable_v<T>, "SharedFIFOQueue requires trivially copyable T");
+
+public:
+    static constexpr uint32_t Magic = 0x51554555;  // "QUEU"
+    static constexpr uint32_t Version = 2;
+
+    // Создаёт новый сегмент `name` (например "/my_queue"). Бросает исключение, если сегмент уже существует.
+    static SharedFIFOQueue create(const std::string& name, size_t capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("SharedFIFOQueue capacity must be positive");
+        }
+
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+
+        size_t bytes = mapping_size(capacity);
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) < 0) {
+            int err = errno;
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            throw std::system_error(err, std::generic_category(), "ftruncate " + name);
+        }
+
+        Header* header = nullptr;
+        try {
+            header = map(fd, bytes);
+        } catch (...) {
+            ::shm_unlink(name.c_str());
+            throw;
+        }
+        SharedFIFOQueue queue{header, bytes};
+        ::close(fd);
+        queue.init(capacity);
+        return queue;
+    }
+
+    // Подключается к сегменту, созданному другим процессом (или этим же).
+    static SharedFIFOQueue attach(const std::string& name) {
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+
+        struct stat st {};
+        if (::fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("SharedFIFOQueue: segment " + name + " is not initialized");
+        }
+
+        size_t bytes = static_cast<size_t>(st.st_size);
+        SharedFIFOQueue queue{map(fd, bytes), bytes};
+        ::close(fd);
+        queue.validate();
+
+        queue.lock();
+        queue._header->attached++;
+        queue.unlock();
+        return queue;
+    }
+
+    // Удаляет имя сегмента; память освобождается после detach'а последнего участника.
+    static void unlink(const std::string& name) { ::shm_unlink(name.c_str()); }
+
+    SharedFIFOQueue(SharedFIFOQueue&& other) noexcept : _header(other._header), _bytes(other._bytes) {
+        other._header = nullptr;
+    }
+
+    SharedFIFOQueue(const SharedFIFOQueue&) = delete;
+    SharedFIFOQueue& operator=(const SharedFIFOQueue&) = delete;
+    SharedFIFOQueue& operator=(SharedFIFOQueue&&) = delete;
+
+    ~SharedFIFOQueue() { detach(); }
+
+    // Не бросает исключений, т.к. вызывается из деструктора. Если mutex непригоден (ENOTRECOVERABLE),
+    // счётчик участников не уменьшается, но отображение всё равно снимается.
+    void detach() noexcept {
+        if (!_header) {
+            return;
+        }
+        int rc = pthread_mutex_lock(&_header->m);
+        if (rc == 0 || rc == EOWNERDEAD) {
+            on_lock_result(rc);
+            _header->attached--;
+            unlock();
+        }
+        ::munmap(_header, _bytes);
+        _header = nullptr;
+    }
+
+    void push(const T& val) {
+        lock();
+        while (_header->tail - _header->head == _header->capacity) {
+            cond_wait(&_header->not_full_cv);
+        }
+        push_locked(val);
+        unlock();
+    }
+
+    T pop() {
+        lock();
+        while (_header->tail == _header->head) {
+            cond_wait(&_header->not_empty_cv);
+        }
+        T val = pop_locked();
+        unlock();
+        return val;
+    }
+
+    // pop с таймаутом, возвращает false, если за timeout элемент так и не появился
+    bool pop(T& out, std::chrono::steady_clock::duration timeout) {
+        timespec deadline = monotonic_deadline(timeout);
+
+        lock();
+        while (_header->tail == _header->head) {
+            if (!cond_timedwait(&_header->not_empty_cv, deadline)) {
+                unlock();
+                return false;
+            }
+        }
+        out = pop_locked();
+        unlock();
+        return true;
+    }
+
+    size_t size() {
+        lock();
+        size_t n = _header->tail - _header->head;
+        unlock();
+        return n;
+    }
+
+    size_t capacity() const { return _header->capacity; }
+
+    // Сколько участников сейчас подключено к сегменту (создатель считается)
+    uint32_t attached() {
+        lock();
+        uint32_t n = _header->attached;
+        unlock();
+        return n;
+    }
+
+    // Сколько раз очередь восстанавливалась после смерти процесса, державшего lock
+    uint32_t recoveries() {
+        lock();
+        uint32_t n = _header->recoveries;
+        unlock();
+        return n;
+    }
+
+protected:
+    struct Header {
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint32_t elem_size;
+        uint32_t elem_align;
+        uint32_t header_size;  // до этого поля раскладка не зависит от ABI pthread
+        uint64_t capacity;
+
+        pthread_mutex_t m;
+        pthread_cond_t not_empty_cv;
+        pthread_cond_t not_full_cv;
+
+        uint64_t head;
+        uint64_t tail;
+        uint32_t attached;
+        uint32_t recoveries;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "magic must be address-free");
+
+    static size_t slots_offset() { return (sizeof(Header) + alignof(T) - 1) / alignof(T) * alignof(T); }
+
+    static size_t mapping_size(size_t capacity) { return slots_offset() + capacity * sizeof(T); }
+
+    static Header* map(int fd, size_t bytes) {
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "mmap");
+        }
+        return static_cast<Header*>(p);
+    }
+
+    SharedFIFOQueue(Header* header, size_t bytes) : _header(header), _bytes(bytes) {}
+
+    void init(size_t capacity) {
+        _header->version = Version;
+        _header->elem_size = sizeof(T);
+        _header->elem_align = alignof(T);
+        _header->header_size = sizeof(Header);
+        _header->capacity = capacity;
+        _header->head = 0;
+        _header->tail = 0;
+        _header->attached = 1;
+        _header->recoveries = 0;
+
+        pthread_mutexattr_t mattr;
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&_header->m, &mattr);
+        pthread_mutexattr_destroy(&mattr);
+
+        pthread_condattr_t cattr;
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+        pthread_cond_init(&_header->not_empty_cv, &cattr);
+        pthread_cond_init(&_header->not_full_cv, &cattr);
+        pthread_condattr_destroy(&cattr);
+
+        // magic пишется последним: увидевший его attach видит и полностью инициализированный заголовок
+        _header->magic.store(Magic, std::memory_order_release);
+    }
+
+    void validate() {
+        const char* error = nullptr;
+        if (_header->magic.load(std::memory_order_acquire) != Magic) {
+            error = "bad magic";
+        } else if (_header->version != Version) {
+            error = "version mismatch";
+        } else if (_header->header_size != sizeof(Header)) {
+            error = "header layout mismatch";
+        } else if (_header->elem_size != sizeof(T) || _header->elem_align != alignof(T)) {
+            error = "element layout mismatch";
+        } else if (mapping_size(_header->capacity) > _bytes) {
+            error = "segment is smaller than its capacity";
+        }
+
+        if (error) {
+            ::munmap(_header, _bytes);
+            _header = nullptr;
+            throw std::runtime_error(std::string{"SharedFIFOQueue: "} + error);
+        }
+    }
+
+    T* slots() { return reinterpret_cast<T*>(reinterpret_cast<char*>(_header) + slots_offset()); }
+
+    void push_locked(const T& val) {
+        std::memcpy(&slots()[_header->tail % _header->capacity], &val, sizeof(T));
+        _header->tail++;
+        pthread_cond_signal(&_header->not_empty_cv);
+    }
+
+    // T не обязан иметь конструктор по умолчанию, поэтому элемент копируется в сырую память
+    T pop_locked() {
+        std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+        std::memcpy(&storage, &slots()[_header->head % _header->capacity], sizeof(T));
+        _header->head++;
+        pthread_cond_signal(&_header->not_full_cv);
+        return *std::launder(reinterpret_cast<T*>(&storage));
+    }
+
+    void lock() { on_lock_result(pthread_mutex_lock(&_header->m)); }
+
+    void unlock() { pthread_mutex_unlock(&_header->m); }
+
+    void cond_wait(pthread_cond_t* cv) { on_lock_result(pthread_cond_wait(cv, &_header->m)); }
+
+    // Возвращает false по таймауту (lock при этом снова захвачен)
+    bool cond_timedwait(pthread_cond_t* cv, const timespec& deadline) {
+        int rc = pthread_cond_timedwait(cv, &_header->m, &deadline);
+        if (rc == ETIMEDOUT) {
+            return false;
+        }
+        on_lock_result(rc);
+        return true;
+    }
+
+    // Владелец lock'а умер. Кольцо согласовано по построению, поэтому достаточно пометить mutex
+    // консистентным и разбудить всех: сигнал, предназначавшийся умершему, мог потеряться.
+    void on_lock_result(int rc) {
+        if (rc == 0) {
+            return;
+        }
+        if (rc == EOWNERDEAD) {
+            pthread_mutex_consistent(&_header->m);
+            _header->recoveries++;
+            if (_header->attached > 0) {
+                _header->attached--;
+            }
+            pthread_cond_broadcast(&_header->not_empty_cv);
+            pthread_cond_broadcast(&_header->not_full_cv);
+            return;
+        }
+        throw std::system_error(rc, std::generic_category(), "pthread_mutex_lock");
+    }
+
+    static timespec monotonic_deadline(std::chrono::steady_clock::duration timeout) {
+        timespec ts{};
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count() + ts.tv_nsec;
+        ts.tv_sec += static_cast<time_t>(ns / 1000000000);
+        ts.tv_nsec = static_cast<long>(ns % 1000000000);
+        return ts;
+    }
+
+    Header* _header;
+    size_t _bytes;
+};
+
+/*
+ * Тесты
+ */
+std::string unique_name(const char* suffix) {
+    return "/hw_shared_queue_" + std::to_string(::getpid()) + "_" + suffix;
+}
+
+// Ждёт завершения дочернего процесса и возвращает его код выхода
+int wait_child(pid_t pid) {
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST(test_push_pop_single_process) {
+    auto name = unique_name("single");
+    auto queue = SharedFIFOQueue<int>::create(name, 4);
+    SharedFIFOQueue<int>::unlink(name);
+
+    queue.push(1);
+    queue.push(2);
+    queue.push(3);
+    EXPECT_EQ(queue.size(), 3u);
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_EQ(queue.pop(), 3);
+
+    int out = 0;
+    EXPECT_FALSE(queue.pop(out, 10ms));
+}
+
+TEST(test_attach_detach) {
+    auto name = unique_name("attach");
+    auto owner = SharedFIFOQueue<int>::create(name, 8);
+    {
+        auto peer = SharedFIFOQueue<int>::attach(name);
+        EXPECT_EQ(peer.capacity(), 8u);
+        EXPECT_EQ(owner.attached(), 2u);
+
+        // Отдельное отображение того же сегмента видит те же данные
+        peer.push(42);
+        EXPECT_EQ(owner.pop(), 42);
+    }
+    EXPECT_EQ(owner.attached(), 1u);
+    SharedFIFOQueue<int>::unlink(name);
+}
+
+TEST(test_layout_validation) {
+    struct Wide {
+        int64_t a;
+        int64_t b;
+    };
+
+    auto name = unique_name("layout");
+    auto owner = SharedFIFOQueue<int>::create(name, 8);
+
+    bool rejected = false;
+    try {
+        SharedFIFOQueue<Wide>::attach(name);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    EXPECT_TRUE(rejected);
+    EXPECT_EQ(owner.attached(), 1u);
+    SharedFIFOQueue<int>::unlink(name);
+}
+
+TEST(test_header_size_validation) {
+    auto name = unique_name("header");
+    auto owner = SharedFIFOQueue<int>::create(name, 8);
+
+    // Имитируем участника, у которого pthread-типы другого размера: поле header_size лежит
+    // сразу после четырёх uint32_t, его смещение от ABI pthread не зависит
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    void* p = ::mmap(nullptr, 64, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    auto* header_size = reinterpret_cast<uint32_t*>(static_cast<char*>(p) + 4 * sizeof(uint32_t));
+    uint32_t original = *header_size;
+    *header_size = original + 8;
+
+    bool rejected = false;
+    try {
+        SharedFIFOQueue<int>::attach(name);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    EXPECT_TRUE(rejected);
+
+    *header_size = original;
+    ::munmap(p, 64);
+    SharedFIFOQueue<int>::attach(name).detach();
+    SharedFIFOQueue<int>::unlink(name);
+}
+
+TEST(test_no_default_constructor) {
+    struct Point {
+        Point(int x, int y) : x(x), y(y) {}
+        int x;
+        int y;
+    };
+
+    auto name = unique_name("nodefault");
+    auto queue = SharedFIFOQueue<Point>::create(name, 2);
+    SharedFIFOQueue<Point>::unlink(name);
+
+    queue.push(Point{1, 2});
+    Point p = queue.pop();
+    EXPECT_EQ(p.x, 1);
+    EXPECT_EQ(p.y, 2);
+}
+
+TEST(test_cross_process) {
+    constexpr int N = 1000;
+
+    auto name = unique_name("fork");
+    auto queue = SharedFIFOQueue<int>::create(name, 16);
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        // Дочерний процесс - producer; ёмкость меньше N, так что он будет ждать consumer'а
+        try {
+            auto producer = SharedFIFOQueue<int>::attach(name);
+            for (int i = 0; i < N; ++i) {
+                producer.push(i);
+            }
+            producer.detach();
+        } catch (...) {
+            ::_exit(1);
+        }
+        ::_exit(0);
+    }
+
+    for (int i = 0; i < N; ++i) {
+        EXPECT_EQ(queue.pop(), i);
+    }
+    EXPECT_EQ(wait_child(pid), 0);
+    EXPECT_EQ(queue.attached(), 1u);
+    SharedFIFOQueue<int>::unlink(name);
+}
+
+// Даёт тесту доступ к сырому mutex'у, чтобы умереть, держа его
+class LockingPeer : public SharedFIFOQueue<int> {
+public:
+    explicit LockingPeer(SharedFIFOQueue<int>&& q) : SharedFIFOQueue<int>(std::move(q)) {}
+
+    void push_and_die_holding_lock(int val) {
+        lock();
+        push_locked(val);
+        ::_exit(0);
+    }
+};
+
+TEST(test_recover_after_peer_death) {
+    auto name = unique_name("robust");
+    auto queue = SharedFIFOQueue<int>::create(name, 4);
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        try {
+            LockingPeer peer{SharedFIFOQueue<int>::attach(name)};
+            peer.push_and_die_holding_lock(7);
+        } catch (...) {
+        }
+        ::_exit(1);
+    }
+    EXPECT_EQ(wait_child(pid), 0);
+
+    // Lock брошен умершим процессом, но очередь должна продолжить работу
+    EXPECT_EQ(queue.pop(), 7);
+    EXPECT_EQ(queue.recoveries(), 1u);
+    EXPECT_EQ(queue.attached(), 1u);
+
+    queue.push(8);
+    EXPECT_EQ(queue.pop(), 8);
+    SharedFIFOQueue<int>::unlink(name);
+}
+
+int main() {
+    RUN_TESTS();
+    return 0;
+}
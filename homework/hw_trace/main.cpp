@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tests.h"
+#include "trace.h"
+#include "bench.h"
+
+// Эта цель всегда собирается с CONDVAR_TRACE, см. CMakeLists.txt
+
+using namespace std::chrono_literals;
+
+// ThreadFlag из task-2 с расставленными точками трассировки
+class ThreadFlag {
+public:
+    void wait() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        // Ожидание записывается, только если поток действительно засыпает
+        if (!_flag) {
+            TRACE_WAIT_BEGIN(&_cv);
+            _cv.wait(l, [this]() { return _flag; });
+            TRACE_WAIT_END(&_cv);
+        }
+    }
+
+    void set_flag() {
+        std::unique_lock l{_m};
+        TRACE_LOCK_ACQUIRED(&_m);
+        _flag = true;
+        TRACE_NOTIFY(&_cv);
+        _cv.notify_all();
+    }
+
+    const void* id() const { return &_cv; }
+
+private:
+    std::mutex _m;
+    std::condition_variable _cv;
+    bool _flag{};
+};
+
+size_t count_substr(const std::string& s, const std::string& sub) {
+    size_t n = 0;
+    for (size_t pos = s.find(sub); pos != std::string::npos; pos = s.find(sub, pos + sub.size())) {
+        ++n;
+    }
+    return n;
+}
+
+/*
+ * Тесты
+ */
+TEST(test_records_wait_and_notify) {
+    trace::reset();
+
+    ThreadFlag flag;
+    std::thread waiter{[&]() { flag.wait(); }};
+    std::this_thread::sleep_for(5ms);
+    flag.set_flag();
+    waiter.join();
+
+    size_t waits = 0;
+    size_t notifies = 0;
+    for (const auto& e : trace::collect()) {
+        if (e.obj != flag.id()) {
+            continue;
+        }
+        waits += e.type == trace::EventType::WaitBegin || e.type == trace::EventType::WaitEnd;
+        notifies += e.type == trace::EventType::Notify;
+    }
+    EXPECT_EQ(waits, 2u);
+    EXPECT_EQ(notifies, 1u);
+}
+
+TEST(test_chrome_json) {
+    trace::reset();
+
+    ThreadFlag flag;
+    std::thread waiter{[&]() { flag.wait(); }};
+    std::this_thread::sleep_for(5ms);
+    flag.set_flag();
+    waiter.join();
+
+    std::ostringstream out;
+    trace::dump_chrome_json(out);
+    std::string json = out.str();
+
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\"", 0), 0u);
+    EXPECT_EQ(count_substr(json, "\"ph\":\"B\""), 1u);
+    EXPECT_EQ(count_substr(json, "\"ph\":\"E\""), 1u);
+    EXPECT_EQ(count_substr(json, "\"name\":\"notify\""), 1u);
+    EXPECT_EQ(count_substr(json, "\"name\":\"lock\""), 2u);
+
+    // Стрелка от notify в главном потоке к концу ожидания в waiter'е
+    EXPECT_EQ(count_substr(json, "\"ph\":\"s\""), 1u);
+    EXPECT_EQ(count_substr(json, "\"ph\":\"f\""), 1u);
+}
+
+TEST(test_no_wait_when_flag_already_set) {
+    trace::reset();
+
+    ThreadFlag flag;
+    std::thread setter{[&]() { flag.set_flag(); }};
+    setter.join();
+    flag.wait();  // Флаг уже установлен - поток не засыпает
+
+    std::ostringstream out;
+    trace::dump_chrome_json(out);
+    std::string json = out.str();
+
+    EXPECT_EQ(count_substr(json, "\"ph\":\"B\""), 0u);
+    EXPECT_EQ(count_substr(json, "\"name\":\"wakeup\""), 0u);
+}
+
+TEST(test_no_wakeup_from_notify_before_wait) {
+    trace::reset();
+
+    int obj = 0;
+    std::thread notifier{[&]() { TRACE_NOTIFY(&obj); }};
+    notifier.join();
+
+    // Ожидание началось после notify другого потока - разбудить его этот notify не мог
+    TRACE_WAIT_BEGIN(&obj);
+    TRACE_WAIT_END(&obj);
+
+    std::ostringstream out;
+    trace::dump_chrome_json(out);
+    std::string json = out.str();
+
+    EXPECT_EQ(count_substr(json, "\"ph\":\"B\""), 1u);
+    EXPECT_EQ(count_substr(json, "\"name\":\"wakeup\""), 0u);
+}
+
+TEST(test_ring_keeps_latest_events) {
+    trace::reset();
+
+    std::thread writer{[]() {
+        for (size_t i = 0; i < trace::RingSize + 100; ++i) {
+            TRACE_NOTIFY(reinterpret_cast<const void*>(i));
+        }
+    }};
+    writer.join();
+
+    auto events = trace::collect();
+    EXPECT_EQ(events.size(), trace::RingSize);
+    EXPECT_EQ(reinterpret_cast<size_t>(events.front().obj), 100u);
+    EXPECT_EQ(reinterpret_cast<size_t>(events.back().obj), trace::RingSize + 99);
+}
+
+TEST(test_rings_reused_after_thread_exit) {
+    for (int i = 0; i < 100; ++i) {
+        std::thread t{[]() { TRACE_NOTIFY(nullptr); }};
+        t.join();
+    }
+    // Потоки шли по одному, поэтому им хватило пары буферов (главного и одного переиспользуемого)
+    EXPECT_LE(trace::ring_count(), 4u);
+}
+
+/*
+ * Бенчмарки
+ */
+BENCH(bench_trace_event) {
+    constexpr int EventsPerThread = 10000000;
+
+    for (int threads : {1, 4}) {
+        auto elapsed = run_threads(threads, [](int) {
+            for (int i = 0; i < EventsPerThread; ++i) {
+                TRACE_NOTIFY(&i);
+            }
+        });
+        report("trace event", threads, size_t{EventsPerThread} * threads, elapsed);
+        // Процессорное время на событие: потоков больше, чем ядер, не ускоряют запись, а делят ядро.
+        // Почти вся стоимость - чтение метки времени, сравните с ним.
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        std::printf("        cpu time per event: %.1f ns\n",
+                    static_cast<double>(elapsed.count()) * std::min<unsigned>(threads, cores) /
+                        (static_cast<double>(EventsPerThread) * threads));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sink = 0;
+    for (int i = 0; i < EventsPerThread; ++i) {
+        sink += trace::now_ticks();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("        timestamp alone: %.1f ns (%llu)\n",
+                static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+                    EventsPerThread,
+                static_cast<unsigned long long>(sink & 1));
+}
+
+int main(int argc, char** argv) {
+    RUN_BENCHES(argc, argv);
+    RUN_TESTS();
+    return 0;
+}
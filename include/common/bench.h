@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Бенчмарки регистрируются так же, как тесты, но запускаются только с флагом `--bench`:
+//     > ./build/hw_priority_queue --bench
+// Обычный запуск (в т.ч. из ctest) выполняет только тесты.
+
+using BenchFunc = void (*)();
+
+std::vector<BenchFunc> _all_benches;
+
+#define BENCH(benchFunc) \
+    void benchFunc(); \
+    struct benchFunc##_registrar { \
+        benchFunc##_registrar() { _all_benches.push_back(benchFunc); } \
+    } benchFunc##_instance; \
+    void benchFunc()
+
+#define RUN_BENCHES(argc, argv) \
+    if ((argc) > 1 && std::string{(argv)[1]} == "--bench") { \
+        for (BenchFunc bench : _all_benches) { \
+            (*bench)(); \
+        } \
+        return 0; \
+    }
+
+// Количество потоков, на которых меряются бенчмарки
+const std::vector<int> BenchThreadCounts{1, 2, 4, 8, 16, 32};
+
+// Запускает func(thread_idx) одновременно в num_threads потоках и возвращает время от старта до завершения последнего
+template <typename Func>
+std::chrono::nanoseconds run_threads(int num_threads, Func&& func) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(func, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return std::chrono::steady_clock::now() - start;
+}
+
+// Печатает строку вида `[BENCH] name threads=4: 12.34 Mops/s`
+inline void report(const std::string& name, int num_threads, size_t ops, std::chrono::nanoseconds elapsed) {
+    double mops = elapsed.count() ? static_cast<double>(ops) * 1000.0 / static_cast<double>(elapsed.count()) : 0.0;
+    std::printf("[BENCH] %s threads=%d: %.2f Mops/s\n", name.c_str(), num_threads, mops);
+    std::fflush(stdout);
+}
@@ -7,6 +7,7 @@
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include "trace.h"
 
 using TestFunc = bool (*)();
 
@@ -55,6 +56,7 @@ struct TestContext {
 };
 
 // Макрос запускает тест N раз, а так же вызывает exit, если тест не завершился за 2 секунды
+// (с включённой трассировкой перед выходом сохраняет события в <test>.trace.json)
 #define REPEATED_TEST(testFunc, N) \
     void testFunc(const TestContext &); \
     bool testFunc##_wrapper() { \
@@ -70,6 +72,7 @@ struct TestContext {
             }); \
             if (!finish) { \
                 std::cerr << "[FAIL] Test " #testFunc " can't proceed" << std::endl; \
+                TRACE_DUMP(#testFunc ".trace.json"); \
                 std::exit(1); \
             } \
         }); \
@@ -0,0 +1,280 @@
+#pragma once
+
+// Трассировка ожиданий и пробуждений. Включается определением CONDVAR_TRACE (cmake -DENABLE_TRACE=ON),
+// иначе все макросы TRACE_* раскрываются в ((void)0), а аргументы даже не вычисляются.
+//
+// Каждый поток пишет события в свой кольцевой буфер без блокировок: запись - это копирование 24 байт
+// и один store, плюс чтение метки времени. Когда буфер заполнен, старые события перезаписываются.
+// На x86 метка - счётчик тактов TSC (rdtsc в разы дешевле steady_clock::now()), в наносекунды он переводится
+// только при collect(). Предполагается invariant TSC, синхронный между ядрами, как у всех современных x86.
+// На остальных платформах метка - steady_clock в наносекундах.
+// TRACE_DUMP(path) сохраняет события всех потоков в формате Chrome trace (chrome://tracing, ui.perfetto.dev):
+// ожидания - отрезки на линии потока, notify и захват lock'а - точки, а стрелка "wakeup" ведёт от последнего
+// notify того же объекта из другого потока, случившегося во время ожидания, к его концу.
+//
+// TRACE_WAIT_BEGIN/END ставятся только вокруг настоящего сна: если условие уже выполнено и поток не засыпает,
+// ожидание не записывается. TRACE_LOCK_ACQUIRED ставится сразу после захвата mutex'а примитива.
+//
+// Дамп читает буферы без синхронизации с писателями: события, записанные во время дампа, могут не попасть в него
+// (или попасть частично), поэтому дамп делается, когда система уже "встала", или после остановки потоков.
+
+#ifdef CONDVAR_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CONDVAR_TRACE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace trace {
+
+enum class EventType : uint8_t { WaitBegin, WaitEnd, Notify, LockAcquired };
+
+struct Event {
+    uint64_t ts;  // в буфере - now_ticks(), в результате collect() - наносекунды steady_clock
+    const void* obj;
+    uint32_t tid;
+    EventType type;
+};
+
+constexpr size_t RingSize = 4096;  // степень двойки
+
+struct ThreadRing {
+    std::atomic<uint64_t> head{0};
+    uint32_t tid{};
+    bool in_use{};
+    Event events[RingSize];
+};
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+inline uint64_t now_ticks() {
+#ifdef CONDVAR_TRACE_TSC
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+struct Registry {
+    std::mutex m;
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+    uint32_t next_tid{1};
+
+    // Точка отсчёта для перевода тактов в наносекунды. Регистр создаётся до первого события,
+    // поэтому все метки в буферах не меньше base_ticks.
+    uint64_t base_ticks{now_ticks()};
+    uint64_t base_ns{now_ns()};
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+// Буфер закрепляется за потоком при первом событии и освобождается при его завершении.
+// Освобождённый буфер (вместе с событиями) достаётся следующему новому потоку, поэтому память
+// ограничена максимальным числом одновременно трассирующих потоков, а не числом потоков за всё время.
+class RingHolder {
+public:
+    RingHolder() {
+        Registry& r = registry();
+        std::unique_lock l{r.m};
+        for (auto& ring : r.rings) {
+            if (!ring->in_use) {
+                _ring = ring.get();
+                break;
+            }
+        }
+        if (!_ring) {
+            r.rings.push_back(std::make_unique<ThreadRing>());
+            _ring = r.rings.back().get();
+        }
+        _ring->in_use = true;
+        _ring->tid = r.next_tid++;
+    }
+
+    ~RingHolder() {
+        std::unique_lock l{registry().m};
+        _ring->in_use = false;
+    }
+
+    ThreadRing* ring() const { return _ring; }
+
+private:
+    ThreadRing* _ring{};
+};
+
+// Указатель без конструктора читается без проверки инициализации thread_local, в отличие от RingHolder
+inline ThreadRing* thread_ring() {
+    thread_local ThreadRing* ring = nullptr;
+    if (!ring) {
+        thread_local RingHolder holder;
+        ring = holder.ring();
+    }
+    return ring;
+}
+
+inline void record(EventType type, const void* obj) {
+    ThreadRing* ring = thread_ring();
+
+    uint64_t h = ring->head.load(std::memory_order_relaxed);
+    ring->events[h & (RingSize - 1)] = Event{now_ticks(), obj, ring->tid, type};
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+// Перевод тактов в наносекунды: частота TSC измеряется по steady_clock на отрезке от создания регистра
+// до текущего момента, но не короче 10 мс, чтобы погрешность чтения часов была пренебрежимой
+inline void ticks_to_ns(Registry& r, std::vector<Event>& events) {
+#ifdef CONDVAR_TRACE_TSC
+    uint64_t ticks = now_ticks();
+    uint64_t ns = now_ns();
+    while (ns - r.base_ns < 10000000) {
+        ticks = now_ticks();
+        ns = now_ns();
+    }
+    double ns_per_tick = static_cast<double>(ns - r.base_ns) / static_cast<double>(ticks - r.base_ticks);
+    for (Event& e : events) {
+        e.ts = r.base_ns + static_cast<uint64_t>(static_cast<double>(e.ts - r.base_ticks) * ns_per_tick);
+    }
+#else
+    (void)r;
+    (void)events;
+#endif
+}
+
+// Все события из всех буферов, упорядоченные по времени, с метками в наносекундах
+inline std::vector<Event> collect() {
+    std::vector<Event> events;
+    Registry& r = registry();
+    std::unique_lock l{r.m};
+    for (auto& ring : r.rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = head > RingSize ? head - RingSize : 0;
+        for (uint64_t i = begin; i < head; ++i) {
+            events.push_back(ring->events[i & (RingSize - 1)]);
+        }
+    }
+    ticks_to_ns(r, events);
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.ts < b.ts; });
+    return events;
+}
+
+// Сбрасывает все буферы. Вызывать, только когда ни один поток не пишет события.
+inline void reset() {
+    Registry& r = registry();
+    std::unique_lock l{r.m};
+    for (auto& ring : r.rings) {
+        ring->head.store(0);
+    }
+}
+
+// Количество созданных буферов (для тестов переиспользования)
+inline size_t ring_count() {
+    Registry& r = registry();
+    std::unique_lock l{r.m};
+    return r.rings.size();
+}
+
+inline void dump_chrome_json(std::ostream& out) {
+    std::vector<Event> events = collect();
+
+    char buf[256];
+    bool first = true;
+    auto emit = [&](const char* name, const char* ph, const Event& e, const char* extra) {
+        std::snprintf(buf, sizeof(buf),
+                      "%s{\"name\":\"%s\",\"cat\":\"condvar\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+                      "\"args\":{\"obj\":\"%p\"}%s}",
+                      first ? "" : ",\n", name, ph, static_cast<double>(e.ts) / 1000.0, e.tid, e.obj, extra);
+        out << buf;
+        first = false;
+    };
+
+    // Последний notify по каждому объекту - кандидат в "разбудившие" для конца ожидания,
+    // если он случился между началом и концом этого ожидания
+    std::unordered_map<const void*, Event> last_notify;
+    std::map<std::pair<uint32_t, const void*>, uint64_t> wait_begin;  // (поток, объект) -> начало ожидания
+    uint64_t flow_id = 0;
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    for (const Event& e : events) {
+        switch (e.type) {
+            case EventType::WaitBegin:
+                emit("wait", "B", e, "");
+                wait_begin[{e.tid, e.obj}] = e.ts;
+                break;
+            case EventType::WaitEnd: {
+                // Начало могло быть затёрто в кольцевом буфере - тогда стрелку не рисуем
+                auto begin = wait_begin.find({e.tid, e.obj});
+                auto it = last_notify.find(e.obj);
+                if (begin != wait_begin.end() && it != last_notify.end() && it->second.tid != e.tid &&
+                    it->second.ts >= begin->second) {
+                    char flow[64];
+                    std::snprintf(flow, sizeof(flow), ",\"id\":%llu", static_cast<unsigned long long>(++flow_id));
+                    emit("wakeup", "s", it->second, flow);
+                    std::snprintf(flow, sizeof(flow), ",\"id\":%llu,\"bp\":\"e\"",
+                                  static_cast<unsigned long long>(flow_id));
+                    emit("wakeup", "f", e, flow);
+                }
+                if (begin != wait_begin.end()) {
+                    wait_begin.erase(begin);
+                }
+                emit("wait", "E", e, "");
+                break;
+            }
+            case EventType::Notify:
+                emit("notify", "i", e, ",\"s\":\"t\"");
+                last_notify[e.obj] = e;
+                break;
+            case EventType::LockAcquired:
+                emit("lock", "i", e, ",\"s\":\"t\"");
+                break;
+        }
+    }
+    out << "\n]}\n";
+}
+
+inline void dump_chrome_json(const std::string& path) {
+    std::ofstream out{path};
+    dump_chrome_json(out);
+}
+
+}  // namespace trace
+
+#define TRACE_WAIT_BEGIN(obj) ::trace::record(::trace::EventType::WaitBegin, (obj))
+#define TRACE_WAIT_END(obj) ::trace::record(::trace::EventType::WaitEnd, (obj))
+#define TRACE_NOTIFY(obj) ::trace::record(::trace::EventType::Notify, (obj))
+#define TRACE_LOCK_ACQUIRED(obj) ::trace::record(::trace::EventType::LockAcquired, (obj))
+#define TRACE_DUMP(path) ::trace::dump_chrome_json(path)
+
+#else
+
+#define TRACE_WAIT_BEGIN(obj) ((void)0)
+#define TRACE_WAIT_END(obj) ((void)0)
+#define TRACE_NOTIFY(obj) ((void)0)
+#define TRACE_LOCK_ACQUIRED(obj) ((void)0)
+#define TRACE_DUMP(path) ((void)0)
+
+#endif